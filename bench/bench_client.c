@@ -0,0 +1,395 @@
+//****************************************************************************
+//    Copyright (C) 2022 Orbital Systems AB.
+//    All rights reserved
+//****************************************************************************
+#include "bench_util.h"
+
+#include "iwd_client.h"
+#include "iwd_util.h"
+
+#include <getopt.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// End to end latency of iwd_client against mock_iwd (or a real iwd) on the bus. Run by run_bench.sh.
+// Measures init until ready, then each operation in turn, one at a time except for the burst:
+//   scan                       Scan, until Scanning goes false again
+//   scan_ordered_networks      Scan and get the ordered networks when done
+//   ordered_networks           GetOrderedNetworks into an l_queue, also updating the cache
+//   ordered_networks_packed    GetOrderedNetworks into one allocation
+//   ordered_networks_view      GetOrderedNetworks as views into the reply
+//   ordered_networks_burst     --iterations GetOrderedNetworks at once, latency from the start of the burst
+//   known_networks             iwd_client_known_networks(), from the proxies without any DBUS call
+//   connect                    Connect to --ssid, answering the passphrase from the agent the first time
+//   forget                     Forget --ssid after each connect, so the next connect asks again
+
+typedef enum {
+    BENCH_SCAN,
+    BENCH_SCAN_ORDERED_NETWORKS,
+    BENCH_ORDERED_NETWORKS,
+    BENCH_ORDERED_NETWORKS_PACKED,
+    BENCH_ORDERED_NETWORKS_VIEW,
+    BENCH_ORDERED_NETWORKS_BURST,
+    BENCH_KNOWN_NETWORKS,
+    BENCH_CONNECT,
+    BENCH_FORGET,
+
+    BENCH_COUNT
+} bench_t;
+
+static const char * const bench_names[BENCH_COUNT] = {
+    [BENCH_SCAN] = "scan",
+    [BENCH_SCAN_ORDERED_NETWORKS] = "scan_ordered_networks",
+    [BENCH_ORDERED_NETWORKS] = "ordered_networks",
+    [BENCH_ORDERED_NETWORKS_PACKED] = "ordered_networks_packed",
+    [BENCH_ORDERED_NETWORKS_VIEW] = "ordered_networks_view",
+    [BENCH_ORDERED_NETWORKS_BURST] = "ordered_networks_burst",
+    [BENCH_KNOWN_NETWORKS] = "known_networks",
+    [BENCH_CONNECT] = "connect",
+    [BENCH_FORGET] = "forget",
+};
+
+static struct l_dbus *s_dbus;
+static const char *s_device_name = "wlan0";
+static const char *s_ssid = "mock0000";
+static const char *s_passphrase = "mockpassphrase";
+static unsigned int s_iterations = 100;
+static unsigned int s_scan_iterations = 10;
+static bool s_ready;
+static uint64_t s_init_usec;
+
+static bench_samples_t s_ready_samples;
+static bench_samples_t s_samples[BENCH_COUNT];
+static unsigned int s_failures[BENCH_COUNT];
+
+static bench_t s_bench; // Running
+static unsigned int s_done; // Iterations done of s_bench
+static uint64_t s_start_usec; // Of the operation in flight, or of the burst
+static bool s_scan_waiting; // Scan started, waiting for Scanning to go false
+static bool s_forget_waiting; // Connected, waiting for the KnownNetwork to show up before forgetting it
+
+static void bench_step(void *user_data);
+
+static unsigned int bench_iterations(bench_t bench)
+{
+    switch (bench) {
+    case BENCH_SCAN:
+    case BENCH_SCAN_ORDERED_NETWORKS:
+        return s_scan_iterations;
+    case BENCH_FORGET:
+        return 0; // Done as part of BENCH_CONNECT
+    default:
+        return s_iterations;
+    }
+}
+
+static void bench_record(bench_t bench, iwd_status_t status)
+{
+    bench_samples_add(&s_samples[bench], s_start_usec, l_time_now());
+    if (status != IWD_STATUS_SUCCESS) {
+        s_failures[bench]++;
+        l_debug("bench: %s failed with status=%d", bench_names[bench], status);
+    }
+}
+
+// Next iteration, from the main loop so that nothing is started from within a callback
+static void bench_next(void)
+{
+    s_done++;
+    while (s_bench < BENCH_COUNT && s_done >= bench_iterations(s_bench)) {
+        s_bench++;
+        s_done = 0;
+    }
+    l_idle_oneshot(bench_step, NULL, NULL);
+}
+
+static void scan_started(iwd_status_t status, __attribute__((unused)) void *user_data)
+{
+    if (status != IWD_STATUS_SUCCESS) {
+        bench_record(BENCH_SCAN, status);
+        bench_next();
+        return;
+    }
+    s_scan_waiting = true; // Done when scanning_updated() says it is finished
+}
+
+static void ordered_networks_done(iwd_status_t status, struct l_queue *networks, void *user_data)
+{
+    bench_t bench = L_PTR_TO_UINT(user_data);
+
+    bench_record(bench, status);
+    iwd_network_list_destroy(networks);
+
+    if (bench == BENCH_ORDERED_NETWORKS_BURST) {
+        if (s_samples[bench].count < s_iterations) {
+            return; // Rest of the burst still in flight
+        }
+        s_done = s_iterations - 1;
+    }
+    bench_next();
+}
+
+static void ordered_networks_packed_done(iwd_status_t status, iwd_network_packed_t *networks,
+                                         __attribute__((unused)) void *user_data)
+{
+    bench_record(BENCH_ORDERED_NETWORKS_PACKED, status);
+    iwd_network_packed_destroy(networks);
+    bench_next();
+}
+
+static void ordered_networks_view_done(iwd_status_t status,
+                                       __attribute__((unused)) const iwd_network_view_t *networks,
+                                       __attribute__((unused)) size_t count,
+                                       __attribute__((unused)) void *user_data)
+{
+    bench_record(BENCH_ORDERED_NETWORKS_VIEW, status);
+    bench_next();
+}
+
+static bool bench_is_known(const char *ssid)
+{
+    struct l_queue *list = iwd_client_known_networks();
+
+    bool known = false;
+    for (const struct l_queue_entry *entry = l_queue_get_entries(list); entry; entry = entry->next) {
+        const iwd_known_network_t *known_network = entry->data;
+        if (streq(known_network->name, ssid)) {
+            known = true;
+            break;
+        }
+    }
+
+    iwd_known_network_list_destroy(list);
+    return known;
+}
+
+static void forget_done(iwd_status_t status, __attribute__((unused)) void *user_data)
+{
+    bench_record(BENCH_FORGET, status);
+    bench_next();
+}
+
+static void bench_forget(void)
+{
+    s_forget_waiting = false;
+    s_start_usec = l_time_now();
+    (void)iwd_client_forget(s_ssid, forget_done, NULL);
+}
+
+static void connect_done(iwd_status_t status, __attribute__((unused)) void *user_data)
+{
+    bench_record(BENCH_CONNECT, status);
+
+    if (status != IWD_STATUS_SUCCESS || bench_is_known(s_ssid)) {
+        bench_forget();
+        return;
+    }
+    s_forget_waiting = true; // Forgotten when the KnownNetwork is added
+}
+
+static void known_networks_changed(__attribute__((unused)) uint32_t generation)
+{
+    if (s_forget_waiting && bench_is_known(s_ssid)) {
+        bench_forget();
+    }
+}
+
+static void bench_report(void)
+{
+    printf("%-28s %.3f ms\n", "init_to_ready", s_ready_samples.count ? s_ready_samples.usec[0] / 1000.0 : 0.0);
+    for (bench_t bench = 0; bench < BENCH_COUNT; bench++) {
+        bench_samples_report(&s_samples[bench]);
+        if (s_failures[bench]) {
+            printf("%-28s %u failed\n", "", s_failures[bench]);
+        }
+    }
+}
+
+static void bench_step(__attribute__((unused)) void *user_data)
+{
+    switch (s_bench) {
+    case BENCH_SCAN:
+        s_start_usec = l_time_now();
+        (void)iwd_client_scan_start_async(s_device_name, scan_started, NULL);
+        break;
+    case BENCH_SCAN_ORDERED_NETWORKS:
+        s_start_usec = l_time_now();
+        (void)iwd_client_scan_ordered_networks_async(s_device_name, 10000, ordered_networks_done,
+                                                     L_UINT_TO_PTR(BENCH_SCAN_ORDERED_NETWORKS));
+        break;
+    case BENCH_ORDERED_NETWORKS:
+        s_start_usec = l_time_now();
+        (void)iwd_client_ordered_networks_async(s_device_name, ordered_networks_done,
+                                                L_UINT_TO_PTR(BENCH_ORDERED_NETWORKS));
+        break;
+    case BENCH_ORDERED_NETWORKS_PACKED:
+        s_start_usec = l_time_now();
+        (void)iwd_client_ordered_networks_packed_async(s_device_name, ordered_networks_packed_done, NULL);
+        break;
+    case BENCH_ORDERED_NETWORKS_VIEW:
+        s_start_usec = l_time_now();
+        (void)iwd_client_ordered_networks_view_async(s_device_name, ordered_networks_view_done, NULL);
+        break;
+    case BENCH_ORDERED_NETWORKS_BURST:
+        s_start_usec = l_time_now();
+        for (unsigned int i = 0; i < s_iterations; i++) {
+            (void)iwd_client_ordered_networks_async(s_device_name, ordered_networks_done,
+                                                    L_UINT_TO_PTR(BENCH_ORDERED_NETWORKS_BURST));
+        }
+        break;
+    case BENCH_KNOWN_NETWORKS:
+        for (unsigned int i = 0; i < s_iterations; i++) {
+            s_start_usec = l_time_now();
+            iwd_known_network_list_destroy(iwd_client_known_networks());
+            bench_record(BENCH_KNOWN_NETWORKS, IWD_STATUS_SUCCESS);
+        }
+        s_done = s_iterations - 1;
+        bench_next();
+        break;
+    case BENCH_CONNECT:
+        s_start_usec = l_time_now();
+        (void)iwd_client_connect(s_device_name, s_ssid, s_passphrase, IWD_CONNECT_NOT_HIDDEN, connect_done, NULL);
+        break;
+    default:
+        bench_report();
+        l_main_quit();
+        break;
+    }
+}
+
+static void ready(void)
+{
+    if (s_ready) {
+        l_warn("bench: iwd restarted during the benchmark");
+        return;
+    }
+    s_ready = true;
+
+    bench_samples_add(&s_ready_samples, s_init_usec, l_time_now());
+    while (s_bench < BENCH_COUNT && bench_iterations(s_bench) == 0) {
+        s_bench++;
+    }
+    l_idle_oneshot(bench_step, NULL, NULL);
+}
+
+static void scanning_updated(const char *device_name, bool scan_running, bool startup)
+{
+    if (s_scan_waiting && !scan_running && !startup && streq(device_name, s_device_name)) {
+        s_scan_waiting = false;
+        bench_record(BENCH_SCAN, IWD_STATUS_SUCCESS);
+        bench_next();
+    }
+}
+
+static void connected_ssid_updated(__attribute__((unused)) const char *device_name,
+                                   __attribute__((unused)) const char *ssid,
+                                   __attribute__((unused)) bool startup)
+{
+}
+
+static void signal_handler(uint32_t signo, __attribute__((unused)) void *user_data)
+{
+    if (signo == SIGINT || signo == SIGTERM) {
+        bench_report();
+        l_main_quit();
+    }
+}
+
+static void usage(void)
+{
+    printf("bench_client [options]\n"
+           "  --iterations N        Of each operation (default 100)\n"
+           "  --scan-iterations N   Of scan and scan_ordered_networks (default 10)\n"
+           "  --device NAME         Device to use (default wlan0)\n"
+           "  --ssid SSID           Network to connect to and forget (default mock0000)\n"
+           "  --passphrase PSK      Of --ssid (default mockpassphrase)\n"
+           "  --system              Use the system bus instead of the session bus\n");
+}
+
+int main(int argc, char *argv[])
+{
+    static const struct option options[] = {
+        { "iterations", required_argument, NULL, 'i' },
+        { "scan-iterations", required_argument, NULL, 'I' },
+        { "device", required_argument, NULL, 'd' },
+        { "ssid", required_argument, NULL, 's' },
+        { "passphrase", required_argument, NULL, 'p' },
+        { "system", no_argument, NULL, 'S' },
+        { "help", no_argument, NULL, 'h' },
+        { NULL, 0, NULL, 0 }
+    };
+
+    bool system_bus = false;
+    int opt;
+    while ((opt = getopt_long(argc, argv, "h", options, NULL)) != -1) {
+        switch (opt) {
+        case 'i':
+            s_iterations = strtoul(optarg, NULL, 0);
+            break;
+        case 'I':
+            s_scan_iterations = strtoul(optarg, NULL, 0);
+            break;
+        case 'd':
+            s_device_name = optarg;
+            break;
+        case 's':
+            s_ssid = optarg;
+            break;
+        case 'p':
+            s_passphrase = optarg;
+            break;
+        case 'S':
+            system_bus = true;
+            break;
+        default:
+            usage();
+            return opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+    if (s_iterations == 0) {
+        s_iterations = 1;
+    }
+
+    if (!l_main_init()) {
+        return EXIT_FAILURE;
+    }
+    l_log_set_stderr();
+
+    s_dbus = l_dbus_new_default(system_bus ? L_DBUS_SYSTEM_BUS : L_DBUS_SESSION_BUS);
+    if (s_dbus == NULL) {
+        l_error("bench: Failed to connect to the bus");
+        l_main_exit();
+        return EXIT_FAILURE;
+    }
+
+    bench_samples_init(&s_ready_samples, "init_to_ready", 1);
+    for (bench_t bench = 0; bench < BENCH_COUNT; bench++) {
+        bench_samples_init(&s_samples[bench], bench_names[bench],
+                           bench == BENCH_FORGET ? s_iterations : bench_iterations(bench));
+    }
+
+    iwd_client_set_known_networks_changed_cb(known_networks_changed);
+    s_init_usec = l_time_now();
+    if (!iwd_client_init(s_dbus, ready, scanning_updated, connected_ssid_updated)) {
+        l_error("bench: iwd_client_init failed");
+    }
+    else {
+        l_main_run_with_signal(signal_handler, NULL);
+    }
+
+    iwd_client_deinit(s_dbus);
+    l_dbus_destroy(s_dbus);
+
+    bench_samples_free(&s_ready_samples);
+    for (bench_t bench = 0; bench < BENCH_COUNT; bench++) {
+        bench_samples_free(&s_samples[bench]);
+    }
+    l_main_exit();
+
+    unsigned int failures = 0;
+    for (bench_t bench = 0; bench < BENCH_COUNT; bench++) {
+        failures += s_failures[bench];
+    }
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,278 @@
+//****************************************************************************
+//    Copyright (C) 2022 Orbital Systems AB.
+//    All rights reserved
+//****************************************************************************
+#include "bench_util.h"
+
+#include "iwd_client.h"
+#include "iwd_client_internal.h"
+#include "iwd_proxies.h"
+#include "iwd_util.h"
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Microbenchmarks of the proxy registry, without a bus. In-memory proxies are plugged in through
+// iwd_proxies_set_ops(): one device with --objects networks, every other one a known network.
+//   proxies_add                Adding all proxies to the registry, one sample
+//   network_for_ssid/1000      iwd_proxies_get_network_for_ssid() of random SSIDs, 1000 per sample
+//   known_networks             iwd_client_known_networks() of all known networks
+//   ordered_networks_build     Resolving every network path and building the iwd_network_t list, as done with
+//                              each reply of GetOrderedNetworks. The decoding of the reply itself needs a real
+//                              l_dbus_message and is not included.
+
+#define BENCH_DEVICE_PATH "/net/connman/iwd/0/4"
+#define BENCH_DEVICE_NAME "wlan0"
+#define BENCH_LOOKUPS_PER_SAMPLE 1000
+
+typedef struct {
+    const char *interface;
+    char *path;
+    char *name;
+    const char *type;
+    const char *device_path; // Network
+    char *known_path; // Network, NULL if not known
+    bool hidden; // KnownNetwork
+} fake_proxy_t;
+
+static const char *fake_get_interface(struct l_dbus_proxy *proxy)
+{
+    return ((fake_proxy_t *)proxy)->interface;
+}
+
+static const char *fake_get_path(struct l_dbus_proxy *proxy)
+{
+    return ((fake_proxy_t *)proxy)->path;
+}
+
+static bool fake_get_string(struct l_dbus_proxy *proxy, const char *name,
+                            __attribute__((unused)) const char *signature, const char **value)
+{
+    fake_proxy_t *fake = (fake_proxy_t *)proxy;
+
+    if (streq(name, "Name")) {
+        *value = fake->name;
+    }
+    else if (streq(name, "Type")) {
+        *value = fake->type;
+    }
+    else if (streq(name, "Device")) {
+        *value = fake->device_path;
+    }
+    else if (streq(name, "KnownNetwork")) {
+        *value = fake->known_path;
+    }
+    else if (streq(name, "State")) {
+        *value = "disconnected";
+    }
+    else {
+        *value = NULL; // ConnectedNetwork, not connected
+    }
+    return *value != NULL;
+}
+
+static bool fake_get_bool(struct l_dbus_proxy *proxy, const char *name, bool *value)
+{
+    fake_proxy_t *fake = (fake_proxy_t *)proxy;
+
+    *value = streq(name, "Hidden") ? fake->hidden : false; // Connected, Scanning
+    return true;
+}
+
+static const iwd_proxies_ops_t fake_ops = {
+    .get_interface = fake_get_interface,
+    .get_path = fake_get_path,
+    .get_string = fake_get_string,
+    .get_bool = fake_get_bool,
+};
+
+static fake_proxy_t *s_fakes;
+static unsigned int s_fake_count;
+static unsigned int s_network_count;
+
+static void fakes_create(unsigned int networks)
+{
+    s_network_count = networks;
+    s_fake_count = 2 + networks + (networks + 1) / 2; // Device, Station, Networks, KnownNetworks
+    s_fakes = l_new(fake_proxy_t, s_fake_count);
+
+    fake_proxy_t *fake = s_fakes;
+    fake->interface = "net.connman.iwd.Device";
+    fake->path = l_strdup(BENCH_DEVICE_PATH);
+    fake->name = l_strdup(BENCH_DEVICE_NAME);
+    fake++;
+
+    fake->interface = "net.connman.iwd.Station";
+    fake->path = l_strdup(BENCH_DEVICE_PATH);
+    fake++;
+
+    fake_proxy_t *known = fake + networks;
+    for (unsigned int i = 0; i < networks; i++, fake++) {
+        fake->interface = "net.connman.iwd.Network";
+        fake->name = l_strdup_printf("bench%06u", i);
+        fake->type = i % 4 ? "psk" : "open";
+        fake->path = l_strdup_printf(BENCH_DEVICE_PATH "/%s_%s", fake->name, fake->type);
+        fake->device_path = BENCH_DEVICE_PATH;
+
+        if (i % 2 == 0) {
+            known->interface = "net.connman.iwd.KnownNetwork";
+            known->name = l_strdup(fake->name);
+            known->type = fake->type;
+            known->hidden = i % 8 == 0;
+            known->path = l_strdup_printf("/net/connman/iwd/%s_%s", fake->name, fake->type);
+            fake->known_path = known->path;
+            known++;
+        }
+    }
+}
+
+static void fakes_destroy(void)
+{
+    for (unsigned int i = 0; i < s_fake_count; i++) {
+        l_free(s_fakes[i].path);
+        l_free(s_fakes[i].name);
+    }
+    l_free(s_fakes);
+}
+
+static void bench_proxies_add(bench_samples_t *samples)
+{
+    uint64_t start_usec = l_time_now();
+    for (unsigned int i = 0; i < s_fake_count; i++) {
+        iwd_proxies_add((struct l_dbus_proxy *)&s_fakes[i]);
+    }
+    bench_samples_add(samples, start_usec, l_time_now());
+}
+
+static unsigned int bench_network_for_ssid(bench_samples_t *samples, unsigned int rounds)
+{
+    char ssid[16]; // "bench%06u"
+    unsigned int misses = 0;
+
+    for (unsigned int round = 0; round < rounds; round++) {
+        uint64_t start_usec = l_time_now();
+        for (unsigned int i = 0; i < BENCH_LOOKUPS_PER_SAMPLE; i++) {
+            snprintf(ssid, sizeof(ssid), "bench%06u", (unsigned int)rand() % s_network_count);
+            if (iwd_proxies_get_network_for_ssid(BENCH_DEVICE_NAME, ssid) == NULL) {
+                misses++;
+            }
+        }
+        bench_samples_add(samples, start_usec, l_time_now());
+    }
+    return misses;
+}
+
+static unsigned int bench_known_networks(bench_samples_t *samples, unsigned int rounds)
+{
+    unsigned int count = 0;
+
+    for (unsigned int round = 0; round < rounds; round++) {
+        uint64_t start_usec = l_time_now();
+        struct l_queue *list = iwd_client_known_networks();
+        count = l_queue_length(list);
+        iwd_known_network_list_destroy(list);
+        bench_samples_add(samples, start_usec, l_time_now());
+    }
+    return count;
+}
+
+static unsigned int bench_ordered_networks_build(bench_samples_t *samples, unsigned int rounds)
+{
+    unsigned int count = 0;
+
+    for (unsigned int round = 0; round < rounds; round++) {
+        uint64_t start_usec = l_time_now();
+        struct l_queue *list = l_queue_new();
+        for (unsigned int i = 0; i < s_network_count; i++) {
+            const fake_proxy_t *fake = &s_fakes[2 + i];
+            iwd_network_view_t view;
+            if (iwd_client_ordered_networks_resolve(fake->path, (int16_t)(-3000 - i % 6000), &view)) {
+                l_queue_push_tail(list, iwd_network_from_view(&view));
+            }
+        }
+        count = l_queue_length(list);
+        iwd_network_list_destroy(list);
+        bench_samples_add(samples, start_usec, l_time_now());
+    }
+    return count;
+}
+
+static void usage(void)
+{
+    printf("bench_proxies [options]\n"
+           "  --objects N   Networks of the device, half of them known (default 10000)\n"
+           "  --rounds N    Samples of each benchmark (default 100)\n");
+}
+
+int main(int argc, char *argv[])
+{
+    static const struct option options[] = {
+        { "objects", required_argument, NULL, 'o' },
+        { "rounds", required_argument, NULL, 'r' },
+        { "help", no_argument, NULL, 'h' },
+        { NULL, 0, NULL, 0 }
+    };
+
+    unsigned int objects = 10000;
+    unsigned int rounds = 100;
+    int opt;
+    while ((opt = getopt_long(argc, argv, "h", options, NULL)) != -1) {
+        switch (opt) {
+        case 'o':
+            objects = strtoul(optarg, NULL, 0);
+            break;
+        case 'r':
+            rounds = strtoul(optarg, NULL, 0);
+            break;
+        default:
+            usage();
+            return opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+    if (objects == 0 || rounds == 0) {
+        usage();
+        return EXIT_FAILURE;
+    }
+
+    bench_samples_t add_samples;
+    bench_samples_t ssid_samples;
+    bench_samples_t known_samples;
+    bench_samples_t build_samples;
+    bench_samples_init(&add_samples, "proxies_add", 1);
+    bench_samples_init(&ssid_samples, "network_for_ssid/1000", rounds);
+    ssid_samples.ops_per_sample = BENCH_LOOKUPS_PER_SAMPLE;
+    bench_samples_init(&known_samples, "known_networks", rounds);
+    bench_samples_init(&build_samples, "ordered_networks_build", rounds);
+
+    srand(1);
+    fakes_create(objects);
+    iwd_proxies_set_ops(&fake_ops);
+    iwd_proxies_init();
+
+    bench_proxies_add(&add_samples);
+    unsigned int misses = bench_network_for_ssid(&ssid_samples, rounds);
+    unsigned int known = bench_known_networks(&known_samples, rounds);
+    unsigned int built = bench_ordered_networks_build(&build_samples, rounds);
+
+    printf("%u networks, %u known\n", s_network_count, known);
+    bench_samples_report(&add_samples);
+    bench_samples_report(&ssid_samples);
+    bench_samples_report(&known_samples);
+    bench_samples_report(&build_samples);
+
+    bool ok = misses == 0 && built == s_network_count;
+    if (!ok) {
+        printf("FAILED: %u lookups missed, %u of %u networks built\n", misses, built, s_network_count);
+    }
+
+    iwd_proxies_deinit();
+    iwd_proxies_set_ops(NULL);
+    fakes_destroy();
+
+    bench_samples_free(&add_samples);
+    bench_samples_free(&ssid_samples);
+    bench_samples_free(&known_samples);
+    bench_samples_free(&build_samples);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
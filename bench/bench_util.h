@@ -0,0 +1,91 @@
+//****************************************************************************
+//    Copyright (C) 2022 Orbital Systems AB.
+//    All rights reserved
+//****************************************************************************
+#pragma once
+
+#include <ell/ell.h>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Latency samples of one benchmarked operation, reported as p50/p99 and throughput
+
+typedef struct {
+    const char *name;
+    uint64_t *usec; // max
+    size_t count;
+    size_t max;
+    unsigned int ops_per_sample; // Operations timed together in each sample, 1 by default
+    uint64_t start_usec; // First sample started
+    uint64_t end_usec; // Last sample ended
+} bench_samples_t;
+
+static inline void bench_samples_init(bench_samples_t *samples, const char *name, size_t max)
+{
+    samples->name = name;
+    samples->usec = l_new(uint64_t, max);
+    samples->count = 0;
+    samples->max = max;
+    samples->ops_per_sample = 1;
+    samples->start_usec = 0;
+    samples->end_usec = 0;
+}
+
+static inline void bench_samples_free(bench_samples_t *samples)
+{
+    l_free(samples->usec);
+    samples->usec = NULL;
+}
+
+static inline void bench_samples_add(bench_samples_t *samples, uint64_t start_usec, uint64_t end_usec)
+{
+    if (samples->count == 0 || start_usec < samples->start_usec) {
+        samples->start_usec = start_usec;
+    }
+    if (end_usec > samples->end_usec) {
+        samples->end_usec = end_usec;
+    }
+    if (samples->count < samples->max) {
+        samples->usec[samples->count++] = end_usec - start_usec;
+    }
+}
+
+static inline int bench_usec_compare(const void *a, const void *b)
+{
+    uint64_t usec_a = *(const uint64_t *)a;
+    uint64_t usec_b = *(const uint64_t *)b;
+
+    return usec_a < usec_b ? -1 : usec_a > usec_b;
+}
+
+static inline uint64_t bench_percentile(const bench_samples_t *samples, unsigned int percent)
+{
+    size_t i = (samples->count * percent + 99) / 100;
+    return samples->usec[i > 0 ? i - 1 : 0];
+}
+
+// Prints one line, with the times of a sample and the throughput of single operations. Sorts the samples.
+static inline void bench_samples_report(bench_samples_t *samples)
+{
+    if (samples->count == 0) {
+        printf("%-28s no samples\n", samples->name);
+        return;
+    }
+
+    qsort(samples->usec, samples->count, sizeof(samples->usec[0]), bench_usec_compare);
+
+    uint64_t sum = 0;
+    for (size_t i = 0; i < samples->count; i++) {
+        sum += samples->usec[i];
+    }
+
+    uint64_t wall_usec = samples->end_usec - samples->start_usec;
+    printf("%-28s n=%-6zu p50=%9.3f ms  p99=%9.3f ms  mean=%9.3f ms  %10.1f ops/s\n",
+           samples->name, samples->count,
+           bench_percentile(samples, 50) / 1000.0,
+           bench_percentile(samples, 99) / 1000.0,
+           (double)sum / samples->count / 1000.0,
+           wall_usec ? (double)samples->count * samples->ops_per_sample * 1000000.0 / wall_usec : 0.0);
+}
@@ -0,0 +1,740 @@
+//****************************************************************************
+//    Copyright (C) 2022 Orbital Systems AB.
+//    All rights reserved
+//****************************************************************************
+#include <ell/ell.h>
+
+#include <getopt.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Stand-in for net.connman.iwd, for benchmarking iwd_client end to end on a private bus.
+// One station (wlan0) that sees --networks networks, half of them psk and none known at start.
+// Implements what iwd_client uses: the object manager, AgentManager, Device, Station, Network and KnownNetwork.
+// Connect asks the registered agent for the passphrase of unknown psk networks, and makes them known.
+// Every reply can be delayed (--delay-ms) and one method can be made to fail (--fail, --fail-every).
+
+#define IWD_SERVICE "net.connman.iwd"
+#define IWD_AGENT_MANAGER_INTERFACE "net.connman.iwd.AgentManager"
+#define IWD_AGENT_INTERFACE "net.connman.iwd.Agent"
+#define IWD_DEVICE_INTERFACE "net.connman.iwd.Device"
+#define IWD_STATION_INTERFACE "net.connman.iwd.Station"
+#define IWD_NETWORK_INTERFACE "net.connman.iwd.Network"
+#define IWD_KNOWN_NETWORK_INTERFACE "net.connman.iwd.KnownNetwork"
+
+#define MOCK_MANAGER_PATH "/net/connman/iwd"
+#define MOCK_DEVICE_PATH "/net/connman/iwd/0/4"
+#define MOCK_DEVICE_NAME "wlan0"
+
+typedef struct mock_known mock_known_t;
+
+typedef struct {
+    char *path;
+    char *name;
+    const char *type; // "psk" or "open"
+    int16_t rssi100;
+    bool hidden; // Not registered until ConnectHiddenNetwork
+    bool registered;
+    mock_known_t *known;
+} mock_network_t;
+
+struct mock_known {
+    char *path;
+    mock_network_t *network;
+};
+
+typedef struct {
+    bool scanning;
+    const char *state;
+    mock_network_t *connected;
+    struct l_timeout *scan_timeout;
+} mock_station_t;
+
+typedef struct {
+    struct l_dbus_message *message; // Connect or ConnectHiddenNetwork waiting for the agent
+    mock_network_t *network;
+} mock_connect_t;
+
+static struct l_dbus *s_dbus;
+static mock_station_t s_station = { .state = "disconnected" };
+static mock_network_t *s_networks;
+static unsigned int s_network_count;
+static char *s_agent_sender; // Unique name of the client that registered the agent
+static char *s_agent_path;
+
+static unsigned int s_networks_option = 10;
+static unsigned int s_hidden_option;
+static unsigned int s_delay_ms;
+static unsigned int s_scan_ms = 100;
+static const char *s_fail_method; // Method to fail, NULL if none
+static const char *s_fail_error = IWD_SERVICE ".Failed";
+static unsigned int s_fail_every = 1;
+static unsigned int s_fail_count;
+
+//
+// Replies
+//
+
+static void mock_delayed_send(struct l_timeout *timeout, void *user_data)
+{
+    struct l_dbus_message *reply = user_data;
+
+    l_dbus_send(s_dbus, reply); // Takes the reference
+    l_timeout_remove(timeout);
+}
+
+// Applies the error injection and the delay. Returns the reply to return from the method handler, or NULL if
+// it is sent later.
+static struct l_dbus_message *mock_respond(struct l_dbus_message *message, struct l_dbus_message *reply)
+{
+    if (s_fail_method && strcmp(l_dbus_message_get_member(message), s_fail_method) == 0 &&
+        ++s_fail_count % s_fail_every == 0) {
+        l_dbus_message_unref(reply);
+        reply = l_dbus_message_new_error(message, s_fail_error, "Injected by mock_iwd");
+    }
+
+    if (s_delay_ms == 0) {
+        return reply;
+    }
+
+    l_timeout_create_ms(s_delay_ms, mock_delayed_send, reply, NULL);
+    return NULL;
+}
+
+// As mock_respond(), from outside a method handler
+static void mock_respond_later(struct l_dbus_message *message, struct l_dbus_message *reply)
+{
+    reply = mock_respond(message, reply);
+    if (reply) {
+        l_dbus_send(s_dbus, reply);
+    }
+}
+
+//
+// KnownNetwork
+//
+
+static bool known_property_name(__attribute__((unused)) struct l_dbus *dbus,
+                                __attribute__((unused)) struct l_dbus_message *message,
+                                struct l_dbus_message_builder *builder,
+                                void *user_data)
+{
+    mock_known_t *known = user_data;
+
+    return l_dbus_message_builder_append_basic(builder, 's', known->network->name);
+}
+
+static bool known_property_type(__attribute__((unused)) struct l_dbus *dbus,
+                                __attribute__((unused)) struct l_dbus_message *message,
+                                struct l_dbus_message_builder *builder,
+                                void *user_data)
+{
+    mock_known_t *known = user_data;
+
+    return l_dbus_message_builder_append_basic(builder, 's', known->network->type);
+}
+
+static bool known_property_hidden(__attribute__((unused)) struct l_dbus *dbus,
+                                  __attribute__((unused)) struct l_dbus_message *message,
+                                  struct l_dbus_message_builder *builder,
+                                  void *user_data)
+{
+    mock_known_t *known = user_data;
+    bool hidden = known->network->hidden;
+
+    return l_dbus_message_builder_append_basic(builder, 'b', &hidden);
+}
+
+static void mock_disconnect(void);
+
+static void mock_known_remove(mock_known_t *known)
+{
+    mock_network_t *network = known->network;
+
+    if (s_station.connected == network) {
+        mock_disconnect();
+    }
+
+    network->known = NULL;
+    if (network->registered) {
+        l_dbus_property_changed(s_dbus, network->path, IWD_NETWORK_INTERFACE, "KnownNetwork");
+    }
+
+    l_dbus_unregister_object(s_dbus, known->path);
+    l_free(known->path);
+    l_free(known);
+}
+
+static struct l_dbus_message *method_forget(__attribute__((unused)) struct l_dbus *dbus,
+                                            struct l_dbus_message *message,
+                                            void *user_data)
+{
+    mock_known_t *known = user_data;
+
+    struct l_dbus_message *reply = l_dbus_message_new_method_return(message);
+    mock_known_remove(known);
+    return mock_respond(message, reply);
+}
+
+static void setup_known_network_interface(struct l_dbus_interface *interface)
+{
+    l_dbus_interface_method(interface, "Forget", 0, method_forget, "", "");
+
+    l_dbus_interface_property(interface, "Name", 0, "s", known_property_name, NULL);
+    l_dbus_interface_property(interface, "Type", 0, "s", known_property_type, NULL);
+    l_dbus_interface_property(interface, "Hidden", 0, "b", known_property_hidden, NULL);
+}
+
+static void mock_known_add(mock_network_t *network)
+{
+    mock_known_t *known = l_new(mock_known_t, 1);
+    known->network = network;
+    known->path = l_strdup_printf(MOCK_MANAGER_PATH "/%s_%s", network->name, network->type);
+    network->known = known;
+
+    l_dbus_object_add_interface(s_dbus, known->path, IWD_KNOWN_NETWORK_INTERFACE, known);
+    l_dbus_object_add_interface(s_dbus, known->path, L_DBUS_INTERFACE_PROPERTIES, NULL);
+    l_dbus_property_changed(s_dbus, network->path, IWD_NETWORK_INTERFACE, "KnownNetwork");
+}
+
+//
+// Network
+//
+
+static bool network_property_name(__attribute__((unused)) struct l_dbus *dbus,
+                                  __attribute__((unused)) struct l_dbus_message *message,
+                                  struct l_dbus_message_builder *builder,
+                                  void *user_data)
+{
+    mock_network_t *network = user_data;
+
+    return l_dbus_message_builder_append_basic(builder, 's', network->name);
+}
+
+static bool network_property_type(__attribute__((unused)) struct l_dbus *dbus,
+                                  __attribute__((unused)) struct l_dbus_message *message,
+                                  struct l_dbus_message_builder *builder,
+                                  void *user_data)
+{
+    mock_network_t *network = user_data;
+
+    return l_dbus_message_builder_append_basic(builder, 's', network->type);
+}
+
+static bool network_property_connected(__attribute__((unused)) struct l_dbus *dbus,
+                                       __attribute__((unused)) struct l_dbus_message *message,
+                                       struct l_dbus_message_builder *builder,
+                                       void *user_data)
+{
+    mock_network_t *network = user_data;
+    bool connected = s_station.connected == network;
+
+    return l_dbus_message_builder_append_basic(builder, 'b', &connected);
+}
+
+static bool network_property_device(__attribute__((unused)) struct l_dbus *dbus,
+                                    __attribute__((unused)) struct l_dbus_message *message,
+                                    struct l_dbus_message_builder *builder,
+                                    __attribute__((unused)) void *user_data)
+{
+    return l_dbus_message_builder_append_basic(builder, 'o', MOCK_DEVICE_PATH);
+}
+
+static bool network_property_known_network(__attribute__((unused)) struct l_dbus *dbus,
+                                           __attribute__((unused)) struct l_dbus_message *message,
+                                           struct l_dbus_message_builder *builder,
+                                           void *user_data)
+{
+    mock_network_t *network = user_data;
+
+    if (network->known == NULL) {
+        return false; // Not present
+    }
+    return l_dbus_message_builder_append_basic(builder, 'o', network->known->path);
+}
+
+static void mock_network_register(mock_network_t *network)
+{
+    if (network->registered) {
+        return;
+    }
+    network->registered = true;
+
+    l_dbus_object_add_interface(s_dbus, network->path, IWD_NETWORK_INTERFACE, network);
+    l_dbus_object_add_interface(s_dbus, network->path, L_DBUS_INTERFACE_PROPERTIES, NULL);
+}
+
+static void mock_station_property_changed(const char *property)
+{
+    l_dbus_property_changed(s_dbus, MOCK_DEVICE_PATH, IWD_STATION_INTERFACE, property);
+}
+
+static void mock_disconnect(void)
+{
+    mock_network_t *old = s_station.connected;
+    if (old == NULL) {
+        return;
+    }
+
+    s_station.connected = NULL;
+    s_station.state = "disconnected";
+    l_dbus_property_changed(s_dbus, old->path, IWD_NETWORK_INTERFACE, "Connected");
+    mock_station_property_changed("ConnectedNetwork");
+    mock_station_property_changed("State");
+}
+
+static void mock_connected(mock_network_t *network)
+{
+    mock_disconnect();
+
+    s_station.connected = network;
+    s_station.state = "connected";
+    l_dbus_property_changed(s_dbus, network->path, IWD_NETWORK_INTERFACE, "Connected");
+    mock_station_property_changed("ConnectedNetwork");
+    mock_station_property_changed("State");
+
+    if (network->known == NULL) {
+        mock_known_add(network);
+    }
+}
+
+static void mock_connect_destroy(void *user_data)
+{
+    mock_connect_t *connect = user_data;
+
+    l_dbus_message_unref(connect->message);
+    l_free(connect);
+}
+
+static void mock_request_passphrase_reply(struct l_dbus_message *message, void *user_data)
+{
+    mock_connect_t *connect = user_data;
+
+    const char *passphrase = NULL;
+    if (l_dbus_message_is_error(message) || !l_dbus_message_get_arguments(message, "s", &passphrase)) {
+        mock_respond_later(connect->message,
+                           l_dbus_message_new_error(connect->message, IWD_SERVICE ".Aborted", "No passphrase"));
+        return;
+    }
+
+    mock_connected(connect->network);
+    mock_respond_later(connect->message, l_dbus_message_new_method_return(connect->message));
+}
+
+// Connects right away if no passphrase is needed, or asks the agent for it
+static struct l_dbus_message *mock_connect(struct l_dbus_message *message, mock_network_t *network)
+{
+    if (network->known || strcmp(network->type, "open") == 0) {
+        mock_connected(network);
+        return mock_respond(message, l_dbus_message_new_method_return(message));
+    }
+
+    if (s_agent_sender == NULL) {
+        return mock_respond(message, l_dbus_message_new_error(message, IWD_SERVICE ".NoAgent", "No agent"));
+    }
+
+    struct l_dbus_message *request = l_dbus_message_new_method_call(s_dbus, s_agent_sender, s_agent_path,
+                                                                    IWD_AGENT_INTERFACE, "RequestPassphrase");
+    l_dbus_message_set_arguments(request, "o", network->path);
+
+    mock_connect_t *connect = l_new(mock_connect_t, 1);
+    connect->message = l_dbus_message_ref(message);
+    connect->network = network;
+    l_dbus_send_with_reply(s_dbus, request, mock_request_passphrase_reply, connect, mock_connect_destroy);
+    return NULL;
+}
+
+static struct l_dbus_message *method_connect(__attribute__((unused)) struct l_dbus *dbus,
+                                             struct l_dbus_message *message,
+                                             void *user_data)
+{
+    return mock_connect(message, user_data);
+}
+
+static void setup_network_interface(struct l_dbus_interface *interface)
+{
+    l_dbus_interface_method(interface, "Connect", 0, method_connect, "", "");
+
+    l_dbus_interface_property(interface, "Name", 0, "s", network_property_name, NULL);
+    l_dbus_interface_property(interface, "Type", 0, "s", network_property_type, NULL);
+    l_dbus_interface_property(interface, "Connected", 0, "b", network_property_connected, NULL);
+    l_dbus_interface_property(interface, "Device", 0, "o", network_property_device, NULL);
+    l_dbus_interface_property(interface, "KnownNetwork", 0, "o", network_property_known_network, NULL);
+}
+
+//
+// Device and Station
+//
+
+static bool device_property_name(__attribute__((unused)) struct l_dbus *dbus,
+                                 __attribute__((unused)) struct l_dbus_message *message,
+                                 struct l_dbus_message_builder *builder,
+                                 __attribute__((unused)) void *user_data)
+{
+    return l_dbus_message_builder_append_basic(builder, 's', MOCK_DEVICE_NAME);
+}
+
+static bool device_property_mode(__attribute__((unused)) struct l_dbus *dbus,
+                                 __attribute__((unused)) struct l_dbus_message *message,
+                                 struct l_dbus_message_builder *builder,
+                                 __attribute__((unused)) void *user_data)
+{
+    return l_dbus_message_builder_append_basic(builder, 's', "station");
+}
+
+static bool device_property_powered(__attribute__((unused)) struct l_dbus *dbus,
+                                    __attribute__((unused)) struct l_dbus_message *message,
+                                    struct l_dbus_message_builder *builder,
+                                    __attribute__((unused)) void *user_data)
+{
+    bool powered = true;
+
+    return l_dbus_message_builder_append_basic(builder, 'b', &powered);
+}
+
+static void setup_device_interface(struct l_dbus_interface *interface)
+{
+    l_dbus_interface_property(interface, "Name", 0, "s", device_property_name, NULL);
+    l_dbus_interface_property(interface, "Mode", 0, "s", device_property_mode, NULL);
+    l_dbus_interface_property(interface, "Powered", 0, "b", device_property_powered, NULL);
+}
+
+static bool station_property_scanning(__attribute__((unused)) struct l_dbus *dbus,
+                                      __attribute__((unused)) struct l_dbus_message *message,
+                                      struct l_dbus_message_builder *builder,
+                                      __attribute__((unused)) void *user_data)
+{
+    return l_dbus_message_builder_append_basic(builder, 'b', &s_station.scanning);
+}
+
+static bool station_property_state(__attribute__((unused)) struct l_dbus *dbus,
+                                   __attribute__((unused)) struct l_dbus_message *message,
+                                   struct l_dbus_message_builder *builder,
+                                   __attribute__((unused)) void *user_data)
+{
+    return l_dbus_message_builder_append_basic(builder, 's', s_station.state);
+}
+
+static bool station_property_connected_network(__attribute__((unused)) struct l_dbus *dbus,
+                                               __attribute__((unused)) struct l_dbus_message *message,
+                                               struct l_dbus_message_builder *builder,
+                                               __attribute__((unused)) void *user_data)
+{
+    if (s_station.connected == NULL) {
+        return false; // Not present
+    }
+    return l_dbus_message_builder_append_basic(builder, 'o', s_station.connected->path);
+}
+
+static void mock_scan_done(struct l_timeout *timeout, __attribute__((unused)) void *user_data)
+{
+    l_timeout_remove(timeout);
+    s_station.scan_timeout = NULL;
+
+    // Some movement, so that the results differ between scans
+    for (unsigned int i = 0; i < s_network_count; i++) {
+        s_networks[i].rssi100 += (int16_t)((rand() % 5 - 2) * 100);
+    }
+
+    s_station.scanning = false;
+    mock_station_property_changed("Scanning");
+}
+
+static struct l_dbus_message *method_scan(__attribute__((unused)) struct l_dbus *dbus,
+                                          struct l_dbus_message *message,
+                                          __attribute__((unused)) void *user_data)
+{
+    if (s_station.scanning) {
+        return mock_respond(message, l_dbus_message_new_error(message, IWD_SERVICE ".Busy", "Scanning"));
+    }
+
+    s_station.scanning = true;
+    s_station.scan_timeout = l_timeout_create_ms(s_scan_ms, mock_scan_done, NULL, NULL);
+    mock_station_property_changed("Scanning");
+    return mock_respond(message, l_dbus_message_new_method_return(message));
+}
+
+static int mock_network_compare(const void *a, const void *b)
+{
+    const mock_network_t *network_a = *(const mock_network_t * const *)a;
+    const mock_network_t *network_b = *(const mock_network_t * const *)b;
+
+    return network_b->rssi100 - network_a->rssi100; // Strongest first
+}
+
+static struct l_dbus_message *method_get_ordered_networks(__attribute__((unused)) struct l_dbus *dbus,
+                                                          struct l_dbus_message *message,
+                                                          __attribute__((unused)) void *user_data)
+{
+    mock_network_t **ordered = l_new(mock_network_t *, s_network_count + 1);
+    unsigned int count = 0;
+    for (unsigned int i = 0; i < s_network_count; i++) {
+        if (s_networks[i].registered) {
+            ordered[count++] = &s_networks[i];
+        }
+    }
+    qsort(ordered, count, sizeof(ordered[0]), mock_network_compare);
+
+    struct l_dbus_message *reply = l_dbus_message_new_method_return(message);
+    struct l_dbus_message_builder *builder = l_dbus_message_builder_new(reply);
+    l_dbus_message_builder_enter_array(builder, "(on)");
+    for (unsigned int i = 0; i < count; i++) {
+        l_dbus_message_builder_enter_struct(builder, "on");
+        l_dbus_message_builder_append_basic(builder, 'o', ordered[i]->path);
+        l_dbus_message_builder_append_basic(builder, 'n', &ordered[i]->rssi100);
+        l_dbus_message_builder_leave_struct(builder);
+    }
+    l_dbus_message_builder_leave_array(builder);
+    l_dbus_message_builder_finalize(builder);
+    l_dbus_message_builder_destroy(builder);
+
+    l_free(ordered);
+    return mock_respond(message, reply);
+}
+
+static struct l_dbus_message *method_connect_hidden_network(__attribute__((unused)) struct l_dbus *dbus,
+                                                            struct l_dbus_message *message,
+                                                            __attribute__((unused)) void *user_data)
+{
+    const char *name = NULL;
+    if (!l_dbus_message_get_arguments(message, "s", &name)) {
+        return mock_respond(message, l_dbus_message_new_error(message, IWD_SERVICE ".InvalidArguments",
+                                                              "Invalid arguments"));
+    }
+
+    for (unsigned int i = 0; i < s_network_count; i++) {
+        mock_network_t *network = &s_networks[i];
+        if (strcmp(network->name, name) != 0) {
+            continue;
+        }
+        if (!network->hidden) {
+            return mock_respond(message, l_dbus_message_new_error(message, IWD_SERVICE ".NotHidden",
+                                                                  "Network is not hidden"));
+        }
+        mock_network_register(network);
+        return mock_connect(message, network);
+    }
+
+    return mock_respond(message, l_dbus_message_new_error(message, IWD_SERVICE ".NotFound",
+                                                          "Network not found"));
+}
+
+static void setup_station_interface(struct l_dbus_interface *interface)
+{
+    l_dbus_interface_method(interface, "Scan", 0, method_scan, "", "");
+    l_dbus_interface_method(interface, "GetOrderedNetworks", 0, method_get_ordered_networks,
+                            "a(on)", "", "networks");
+    l_dbus_interface_method(interface, "ConnectHiddenNetwork", 0, method_connect_hidden_network,
+                            "", "s", "name");
+
+    l_dbus_interface_property(interface, "Scanning", 0, "b", station_property_scanning, NULL);
+    l_dbus_interface_property(interface, "State", 0, "s", station_property_state, NULL);
+    l_dbus_interface_property(interface, "ConnectedNetwork", 0, "o", station_property_connected_network, NULL);
+}
+
+//
+// AgentManager
+//
+
+static struct l_dbus_message *method_register_agent(__attribute__((unused)) struct l_dbus *dbus,
+                                                    struct l_dbus_message *message,
+                                                    __attribute__((unused)) void *user_data)
+{
+    const char *path = NULL;
+    if (!l_dbus_message_get_arguments(message, "o", &path)) {
+        return mock_respond(message, l_dbus_message_new_error(message, IWD_SERVICE ".InvalidArguments",
+                                                              "Invalid arguments"));
+    }
+
+    l_free(s_agent_sender);
+    l_free(s_agent_path);
+    s_agent_sender = l_strdup(l_dbus_message_get_sender(message));
+    s_agent_path = l_strdup(path);
+    return mock_respond(message, l_dbus_message_new_method_return(message));
+}
+
+static struct l_dbus_message *method_unregister_agent(__attribute__((unused)) struct l_dbus *dbus,
+                                                      struct l_dbus_message *message,
+                                                      __attribute__((unused)) void *user_data)
+{
+    l_free(s_agent_sender);
+    l_free(s_agent_path);
+    s_agent_sender = NULL;
+    s_agent_path = NULL;
+    return mock_respond(message, l_dbus_message_new_method_return(message));
+}
+
+static void setup_agent_manager_interface(struct l_dbus_interface *interface)
+{
+    l_dbus_interface_method(interface, "RegisterAgent", 0, method_register_agent, "", "o", "path");
+    l_dbus_interface_method(interface, "UnregisterAgent", 0, method_unregister_agent, "", "o", "path");
+}
+
+//
+// Setup
+//
+
+static void mock_networks_create(void)
+{
+    s_network_count = s_networks_option + s_hidden_option;
+    s_networks = l_new(mock_network_t, s_network_count);
+
+    for (unsigned int i = 0; i < s_network_count; i++) {
+        mock_network_t *network = &s_networks[i];
+        network->hidden = i >= s_networks_option;
+        network->name = l_strdup_printf("%s%04u", network->hidden ? "hidden" : "mock", i);
+        network->type = i % 2 ? "open" : "psk";
+        network->rssi100 = (int16_t)(-3000 - (rand() % 6000));
+        network->path = l_strdup_printf(MOCK_DEVICE_PATH "/%s_%s", network->name, network->type);
+        if (!network->hidden) {
+            mock_network_register(network);
+        }
+    }
+}
+
+static void mock_networks_destroy(void)
+{
+    for (unsigned int i = 0; i < s_network_count; i++) {
+        if (s_networks[i].known) {
+            l_free(s_networks[i].known->path);
+            l_free(s_networks[i].known);
+        }
+        l_free(s_networks[i].name);
+        l_free(s_networks[i].path);
+    }
+    l_free(s_networks);
+}
+
+static void mock_name_acquired(__attribute__((unused)) struct l_dbus *dbus, bool success, bool queued,
+                               __attribute__((unused)) void *user_data)
+{
+    if (!success || queued) {
+        l_error("mock_iwd: Failed to own %s", IWD_SERVICE);
+        l_main_quit();
+        return;
+    }
+    l_info("mock_iwd: Ready with %u networks and %u hidden", s_networks_option, s_hidden_option);
+}
+
+static void mock_ready(void *user_data)
+{
+    struct l_dbus *dbus = user_data;
+
+    if (!l_dbus_object_manager_enable(dbus, "/")) {
+        l_error("mock_iwd: Failed to enable the object manager");
+    }
+
+    l_dbus_register_interface(dbus, IWD_AGENT_MANAGER_INTERFACE, setup_agent_manager_interface, NULL, false);
+    l_dbus_register_interface(dbus, IWD_DEVICE_INTERFACE, setup_device_interface, NULL, false);
+    l_dbus_register_interface(dbus, IWD_STATION_INTERFACE, setup_station_interface, NULL, false);
+    l_dbus_register_interface(dbus, IWD_NETWORK_INTERFACE, setup_network_interface, NULL, false);
+    l_dbus_register_interface(dbus, IWD_KNOWN_NETWORK_INTERFACE, setup_known_network_interface, NULL, false);
+
+    l_dbus_object_add_interface(dbus, MOCK_MANAGER_PATH, IWD_AGENT_MANAGER_INTERFACE, NULL);
+    l_dbus_object_add_interface(dbus, MOCK_DEVICE_PATH, IWD_DEVICE_INTERFACE, NULL);
+    l_dbus_object_add_interface(dbus, MOCK_DEVICE_PATH, IWD_STATION_INTERFACE, NULL);
+    l_dbus_object_add_interface(dbus, MOCK_DEVICE_PATH, L_DBUS_INTERFACE_PROPERTIES, NULL);
+
+    mock_networks_create();
+
+    l_dbus_name_acquire(dbus, IWD_SERVICE, false, false, true, mock_name_acquired, NULL);
+}
+
+static void signal_handler(uint32_t signo, __attribute__((unused)) void *user_data)
+{
+    if (signo == SIGINT || signo == SIGTERM) {
+        l_main_quit();
+    }
+}
+
+static void usage(void)
+{
+    printf("mock_iwd [options]\n"
+           "  --networks N        Visible networks (default 10)\n"
+           "  --hidden N          Hidden networks, only reachable by ConnectHiddenNetwork (default 0)\n"
+           "  --delay-ms N        Delay of every reply (default 0)\n"
+           "  --scan-ms N         Time Scanning is true after Scan (default 100)\n"
+           "  --fail M=E          Reply to method M with error E (E defaults to net.connman.iwd.Failed)\n"
+           "  --fail-every N      Only fail every N:th call of M (default 1)\n"
+           "  --system            Use the system bus instead of the session bus\n");
+}
+
+int main(int argc, char *argv[])
+{
+    static const struct option options[] = {
+        { "networks", required_argument, NULL, 'n' },
+        { "hidden", required_argument, NULL, 'H' },
+        { "delay-ms", required_argument, NULL, 'd' },
+        { "scan-ms", required_argument, NULL, 's' },
+        { "fail", required_argument, NULL, 'f' },
+        { "fail-every", required_argument, NULL, 'e' },
+        { "system", no_argument, NULL, 'S' },
+        { "help", no_argument, NULL, 'h' },
+        { NULL, 0, NULL, 0 }
+    };
+
+    bool system_bus = false;
+    int opt;
+    while ((opt = getopt_long(argc, argv, "h", options, NULL)) != -1) {
+        switch (opt) {
+        case 'n':
+            s_networks_option = strtoul(optarg, NULL, 0);
+            break;
+        case 'H':
+            s_hidden_option = strtoul(optarg, NULL, 0);
+            break;
+        case 'd':
+            s_delay_ms = strtoul(optarg, NULL, 0);
+            break;
+        case 's':
+            s_scan_ms = strtoul(optarg, NULL, 0);
+            break;
+        case 'f': {
+            char *error = strchr(optarg, '=');
+            if (error) {
+                *error++ = '\0';
+                s_fail_error = error;
+            }
+            s_fail_method = optarg;
+            break;
+        }
+        case 'e':
+            s_fail_every = strtoul(optarg, NULL, 0);
+            if (s_fail_every == 0) {
+                s_fail_every = 1;
+            }
+            break;
+        case 'S':
+            system_bus = true;
+            break;
+        default:
+            usage();
+            return opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+
+    if (!l_main_init()) {
+        return EXIT_FAILURE;
+    }
+    l_log_set_stderr();
+
+    s_dbus = l_dbus_new_default(system_bus ? L_DBUS_SYSTEM_BUS : L_DBUS_SESSION_BUS);
+    if (s_dbus == NULL) {
+        l_error("mock_iwd: Failed to connect to the bus");
+        l_main_exit();
+        return EXIT_FAILURE;
+    }
+    l_dbus_set_ready_handler(s_dbus, mock_ready, s_dbus, NULL);
+
+    l_main_run_with_signal(signal_handler, NULL);
+
+    l_timeout_remove(s_station.scan_timeout);
+    l_dbus_destroy(s_dbus);
+    mock_networks_destroy();
+    l_free(s_agent_sender);
+    l_free(s_agent_path);
+    l_main_exit();
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,25 @@
+#!/bin/sh
+# Runs bench_client against mock_iwd on a private session bus, once per network count.
+#   NETWORKS      Network counts to run (default "10 100 1000")
+#   ITERATIONS    Of each operation (default 100)
+#   MOCK_ARGS     Extra mock_iwd options, e.g. "--delay-ms 5" or "--fail Scan=net.connman.iwd.Busy --fail-every 3"
+set -e
+
+cd "$(dirname "$0")"
+
+if [ -z "$IWD_BENCH_PRIVATE_BUS" ]; then
+    IWD_BENCH_PRIVATE_BUS=1 exec dbus-run-session -- "$0" "$@"
+fi
+
+status=0
+for networks in ${NETWORKS:-10 100 1000}; do
+    echo "== $networks networks =="
+    # shellcheck disable=SC2086
+    ./mock_iwd --networks "$networks" $MOCK_ARGS &
+    mock=$!
+    ./bench_client --iterations "${ITERATIONS:-100}" "$@" || status=1
+    kill "$mock"
+    wait "$mock" || true
+done
+
+exit $status
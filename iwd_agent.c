@@ -6,16 +6,23 @@
 
 #include "iwd_client.h"  // Get passphrase from connect
 #include "iwd_proxies.h"
+#include "iwd_trace.h"
 
 #include <ell/ell.h>
 
 #include <assert.h>
+#include <string.h>
 
 #define IWD_AGENT_INTERFACE "net.connman.iwd.Agent"
+#define IWD_SIGNAL_LEVEL_AGENT_INTERFACE "net.connman.iwd.SignalLevelAgent"
 #define LOCAL_AGENT_PATH "/iwd_agent" // No need to make a complicated unique path
 
 static bool s_agent_registered;
+static bool s_agent_registering; // RegisterAgent is called, waiting for the reply
 static iwd_agent_get_passphrase_cb_t s_get_passphrase_cb;
+static iwd_agent_signal_level_changed_cb_t s_signal_level_changed_cb;
+static iwd_agent_signal_level_released_cb_t s_signal_level_released_cb;
+static iwd_agent_signal_level_register_failed_cb_t s_signal_level_register_failed_cb;
 
 // Used both with RegisterAgent and UnregisterAgent as they take the same argument (the object path)
 static void agent_setup(struct l_dbus_message *message,
@@ -24,11 +31,22 @@ static void agent_setup(struct l_dbus_message *message,
     l_dbus_message_set_arguments(message, "o", LOCAL_AGENT_PATH);
 }
 
+// user_data of RegisterAgent and UnregisterAgent, for the trace
+typedef struct {
+    const char *method;
+    uint32_t trace_seq;
+} agent_call_t;
+
 // Used both with RegisterAgent and UnregisterAgent
-static void agent_reply(__attribute__((unused)) struct l_dbus_proxy *proxy,
+static void agent_reply(struct l_dbus_proxy *proxy,
                         struct l_dbus_message *msg,
-                        __attribute__((unused)) void *user_data)
+                        void *user_data)
 {
+    const agent_call_t *call = user_data;
+    iwd_trace_reply(proxy, call->method, msg, call->trace_seq);
+
+    s_agent_registering = false;
+
     if (l_dbus_message_is_error(msg)) {
         const char *name = NULL;
         const char *text = NULL;
@@ -45,27 +63,56 @@ static void agent_reply(__attribute__((unused)) struct l_dbus_proxy *proxy,
     }
 }
 
+// RegisterAgent or UnregisterAgent. False if it could not be sent.
+static bool agent_call(struct l_dbus_proxy *proxy_manager, const char *method)
+{
+    agent_call_t *call = l_new(agent_call_t, 1);
+    call->method = method;
+    call->trace_seq = iwd_trace_call(proxy_manager, method);
+
+    uint32_t callid = l_dbus_proxy_method_call(proxy_manager, method,
+                                               agent_setup,
+                                               agent_reply,
+                                               call, // user_data
+                                               l_free); // Nothing else to cleanup if proxy was destroyed during call
+    if (callid == 0) {
+        l_free(call);
+        return false;
+    }
+
+    return true;
+}
+
 bool iwd_agent_manager_register_agent(void)
 {
+    // Registered as soon as the AgentManager shows up, and again when the client is ready
+    if (s_agent_registered || s_agent_registering) {
+        l_debug("iwd_agent: Agent is already %s", s_agent_registered ? "registered" : "registering");
+        return true;
+    }
+
     struct l_dbus_proxy *proxy_manager = iwd_proxies_get_agent_manager();
     if (!proxy_manager) {
         l_error("iwd_agent: Can't get AgentManager proxy");
         return false;
     }
 
-    uint32_t callid =  l_dbus_proxy_method_call(proxy_manager, "RegisterAgent",
-                                               agent_setup,
-                                               agent_reply,
-                                               NULL, // user_data
-                                               NULL); // Nothing to cleanup if proxy was destroyed during call
-    if (callid == 0) {
+    if (!agent_call(proxy_manager, "RegisterAgent")) {
         l_error("iwd_agent: Failed to call RegisterAgent over DBUS to iwd");
         return false;
     }
 
+    s_agent_registering = true;
     return true;
 }
 
+void iwd_agent_manager_disconnected(void)
+{
+    // The registration is gone with iwd. A reply in flight will not come.
+    s_agent_registered = false;
+    s_agent_registering = false;
+}
+
 bool iwd_agent_manager_unregister_agent(void)
 {
     struct l_dbus_proxy *proxy_manager = iwd_proxies_get_agent_manager();
@@ -76,12 +123,7 @@ bool iwd_agent_manager_unregister_agent(void)
 
     s_agent_registered = false;
 
-    uint32_t callid = l_dbus_proxy_method_call(proxy_manager, "UnregisterAgent",
-                                               agent_setup,
-                                               agent_reply,
-                                               NULL, // user_data
-                                               NULL); // Nothing to cleanup if proxy was destroyed during call
-    if (callid == 0) {
+    if (!agent_call(proxy_manager, "UnregisterAgent")) {
         l_error("iwd_agent: Failed to call UnregisterAgent over DBUS to iwd");
         return false;
     }
@@ -94,6 +136,167 @@ bool iwd_agent_is_registered(void)
     return s_agent_registered;
 }
 
+//
+// SignalLevelAgent
+// Registered per station. iwd calls Changed with the index of the level the RSSI is in: 0 when at or above
+// levels[0], count when below all of them.
+//
+
+typedef struct {
+    const char *method;
+    uint32_t trace_seq;
+    char *device_name; // RegisterSignalLevelAgent only
+    uint32_t registration; // RegisterSignalLevelAgent only
+    int16_t levels_dbm[IWD_SIGNAL_LEVELS_MAX];
+    size_t count;
+} signal_level_args_t;
+
+static void signal_level_args_destroy(void *user_data)
+{
+    signal_level_args_t *args = user_data;
+
+    l_free(args->device_name);
+    l_free(args);
+}
+
+static void signal_level_register_setup(struct l_dbus_message *message, void *user_data)
+{
+    const signal_level_args_t *args = user_data;
+
+    struct l_dbus_message_builder *builder = l_dbus_message_builder_new(message);
+    l_dbus_message_builder_append_basic(builder, 'o', LOCAL_AGENT_PATH);
+    l_dbus_message_builder_enter_array(builder, "n");
+    for (size_t i = 0; i < args->count; i++) {
+        l_dbus_message_builder_append_basic(builder, 'n', &args->levels_dbm[i]);
+    }
+    l_dbus_message_builder_leave_array(builder);
+    l_dbus_message_builder_finalize(builder);
+    l_dbus_message_builder_destroy(builder);
+}
+
+// Used both with RegisterSignalLevelAgent and UnregisterSignalLevelAgent
+static void signal_level_reply(struct l_dbus_proxy *proxy,
+                               struct l_dbus_message *msg,
+                               void *user_data)
+{
+    const signal_level_args_t *args = user_data;
+    iwd_trace_reply(proxy, args->method, msg, args->trace_seq);
+
+    if (l_dbus_message_is_error(msg)) {
+        const char *name = NULL;
+        const char *text = NULL;
+        (void)l_dbus_message_get_error(msg, &name, &text);
+        l_error("iwd_agent: Signal level agent call on %s failed: name='%s' text='%s'",
+                l_dbus_proxy_get_path(proxy), name, text);
+
+        if (args->device_name) {
+            s_signal_level_register_failed_cb(args->device_name, args->registration);
+        }
+    }
+    else {
+        l_debug("iwd_agent: Signal level agent call on %s was successful", l_dbus_proxy_get_path(proxy));
+    }
+}
+
+bool iwd_agent_register_signal_level_agent(struct l_dbus_proxy *proxy_station, const char *device_name,
+                                           uint32_t registration, const int16_t *levels_dbm, size_t count)
+{
+    assert(proxy_station);
+    assert(device_name);
+    assert(count > 0 && count <= IWD_SIGNAL_LEVELS_MAX);
+
+    signal_level_args_t *args = l_new(signal_level_args_t, 1);
+    args->method = "RegisterSignalLevelAgent";
+    args->device_name = l_strdup(device_name);
+    args->registration = registration;
+    memcpy(args->levels_dbm, levels_dbm, count * sizeof(levels_dbm[0]));
+    args->count = count;
+
+    args->trace_seq = iwd_trace_call(proxy_station, args->method);
+    uint32_t callid = l_dbus_proxy_method_call(proxy_station, "RegisterSignalLevelAgent",
+                                               signal_level_register_setup,
+                                               signal_level_reply,
+                                               args, // user_data
+                                               signal_level_args_destroy);
+    if (callid == 0) {
+        l_error("iwd_agent: Failed to call RegisterSignalLevelAgent over DBUS to iwd");
+        signal_level_args_destroy(args);
+        return false;
+    }
+
+    return true;
+}
+
+bool iwd_agent_unregister_signal_level_agent(struct l_dbus_proxy *proxy_station)
+{
+    assert(proxy_station);
+
+    signal_level_args_t *args = l_new(signal_level_args_t, 1);
+    args->method = "UnregisterSignalLevelAgent";
+
+    args->trace_seq = iwd_trace_call(proxy_station, args->method);
+    uint32_t callid = l_dbus_proxy_method_call(proxy_station, "UnregisterSignalLevelAgent",
+                                               agent_setup, // Same argument as UnregisterAgent
+                                               signal_level_reply,
+                                               args, // user_data
+                                               signal_level_args_destroy);
+    if (callid == 0) {
+        l_error("iwd_agent: Failed to call UnregisterSignalLevelAgent over DBUS to iwd");
+        signal_level_args_destroy(args);
+        return false;
+    }
+
+    return true;
+}
+
+static struct l_dbus_message *method_signal_level_changed(__attribute__((unused)) struct l_dbus *dbus,
+                                                          struct l_dbus_message *message,
+                                                          __attribute__((unused)) void *user_data)
+{
+    const char *device_path = NULL;
+    uint8_t level = 0;
+    if (!l_dbus_message_get_arguments(message, "oy", &device_path, &level)) {
+        l_error("iwd_agent: Signal level Changed with invalid arguments");
+        return l_dbus_message_new_error(message, IWD_SIGNAL_LEVEL_AGENT_INTERFACE ".Error.Failed",
+                                        "Error: Invalid argument");
+    }
+
+    iwd_trace_record(IWD_TRACE_SIGNAL_LEVEL, "Changed", device_path, NULL, level);
+    s_signal_level_changed_cb(device_path, level);
+
+    return l_dbus_message_new_method_return(message);
+}
+
+static struct l_dbus_message *method_signal_level_release(__attribute__((unused)) struct l_dbus *dbus,
+                                                          struct l_dbus_message *message,
+                                                          __attribute__((unused)) void *user_data)
+{
+    const char *device_path = NULL;
+    if (!l_dbus_message_get_arguments(message, "o", &device_path)) {
+        l_error("iwd_agent: Signal level Release with invalid arguments");
+        return l_dbus_message_new_error(message, IWD_SIGNAL_LEVEL_AGENT_INTERFACE ".Error.Failed",
+                                        "Error: Invalid argument");
+    }
+
+    iwd_trace_record(IWD_TRACE_AGENT, "SignalLevelAgent.Release", device_path, NULL, 0);
+
+    // Normally the station is going away
+    l_info("iwd_agent: Signal level agent on %s released by iwd", device_path);
+    s_signal_level_released_cb(device_path);
+
+    return l_dbus_message_new_method_return(message);
+}
+
+static void signal_level_agent_interface_setup(struct l_dbus_interface *interface)
+{
+    l_dbus_interface_method(interface, "Changed", 0, method_signal_level_changed, "", "oy", "device", "level");
+    l_dbus_interface_method(interface, "Release", 0, method_signal_level_release, "", "o", "device");
+}
+
+//
+// Agent
+//
+
 static struct l_dbus_message *method_passphrase(__attribute__((unused)) struct l_dbus *dbus,
                                                 struct l_dbus_message *message,
                                                 __attribute__((unused)) void *user_data)
@@ -105,6 +308,8 @@ static struct l_dbus_message *method_passphrase(__attribute__((unused)) struct l
                                         "Error: Invalid argument");
    }
 
+    iwd_trace_record(IWD_TRACE_AGENT, "RequestPassphrase", network_path, NULL, 0);
+
     const char *passphrase = s_get_passphrase_cb(network_path);
     if (passphrase == NULL) { // We have no passphrase for the network path prepared
         return l_dbus_message_new_error(message, IWD_AGENT_INTERFACE ".Error.Failed",
@@ -122,9 +327,11 @@ static struct l_dbus_message *method_release(__attribute__((unused)) struct l_db
                                              __attribute__((unused)) void *user_data)
 {
     // Called when iwd kicks us out as Agent. Shouldn't happen.
+    iwd_trace_record(IWD_TRACE_AGENT, "Release", NULL, NULL, 0);
     l_error("iwd_agent: Got RELEASE call from iwd. Should not happen!");
 
     // Try register again
+    s_agent_registered = false;
     iwd_agent_manager_register_agent();
 
     return l_dbus_message_new_method_return(message);
@@ -135,6 +342,7 @@ static struct l_dbus_message *method_cancel(__attribute__((unused)) struct l_dbu
                                             __attribute__((unused)) void *user_data)
 {
     // Called when iwd doesn't want a passphrase anymore. Should not really happen either we are a lib
+    iwd_trace_record(IWD_TRACE_AGENT, "Cancel", NULL, NULL, 0);
     l_error("iwd_agent: Got CANCEL call from iwd. Ignoring!");
 
     // Just ignore the call. Any saved ssid will be overwritten by next connect attempt.
@@ -147,6 +355,7 @@ static struct l_dbus_message *method_unsupported(__attribute__((unused)) struct
                                                  struct l_dbus_message *message,
                                                  __attribute__((unused)) void *user_data)
 {
+    iwd_trace_record(IWD_TRACE_AGENT, l_dbus_message_get_member(message), NULL, NULL, 0);
     l_error("iwd_agent: Got unsupported %s call", l_dbus_message_get_member(message));
 
     return l_dbus_message_new_error(message, IWD_AGENT_INTERFACE ".Error.Unsupported",
@@ -178,11 +387,21 @@ static void agent_interface_setup(struct l_dbus_interface *interface)
                             "password", "network", "user");
 }
 
-bool iwd_agent_init(struct l_dbus *dbus, iwd_agent_get_passphrase_cb_t get_passphrase_cb)
+bool iwd_agent_init(struct l_dbus *dbus,
+                    iwd_agent_get_passphrase_cb_t get_passphrase_cb,
+                    iwd_agent_signal_level_changed_cb_t signal_level_changed_cb,
+                    iwd_agent_signal_level_released_cb_t signal_level_released_cb,
+                    iwd_agent_signal_level_register_failed_cb_t signal_level_register_failed_cb)
 {
     assert(get_passphrase_cb != NULL);
+    assert(signal_level_changed_cb != NULL);
+    assert(signal_level_released_cb != NULL);
+    assert(signal_level_register_failed_cb != NULL);
 
     s_get_passphrase_cb = get_passphrase_cb;
+    s_signal_level_changed_cb = signal_level_changed_cb;
+    s_signal_level_released_cb = signal_level_released_cb;
+    s_signal_level_register_failed_cb = signal_level_register_failed_cb;
 
     if (!l_dbus_register_interface(dbus,
                                    IWD_AGENT_INTERFACE,
@@ -202,6 +421,20 @@ bool iwd_agent_init(struct l_dbus *dbus, iwd_agent_get_passphrase_cb_t get_passp
         return false;
     }
 
+    if (!l_dbus_register_interface(dbus,
+                                   IWD_SIGNAL_LEVEL_AGENT_INTERFACE,
+                                   signal_level_agent_interface_setup,
+                                   NULL, // No destroy handling
+                                   false) ||
+        !l_dbus_object_add_interface(dbus,
+                                     LOCAL_AGENT_PATH,
+                                     IWD_SIGNAL_LEVEL_AGENT_INTERFACE,
+                                     NULL)) { // user_data
+        // The passphrase agent still works without it
+        l_error("iwd_agent: Can't register the SignalLevelAgent interface");
+        l_dbus_unregister_interface(dbus, IWD_SIGNAL_LEVEL_AGENT_INTERFACE);
+    }
+
     return true;
 }
 
@@ -209,4 +442,5 @@ void iwd_agent_deinit(struct l_dbus *dbus)
 {
     l_dbus_unregister_object(dbus, LOCAL_AGENT_PATH);
     l_dbus_unregister_interface(dbus, IWD_AGENT_INTERFACE);
+    l_dbus_unregister_interface(dbus, IWD_SIGNAL_LEVEL_AGENT_INTERFACE);
 }
@@ -7,13 +7,33 @@
 #include <ell/ell.h>
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
 typedef const char *(*iwd_agent_get_passphrase_cb_t)(const char *network_path);
 
-bool iwd_agent_init(struct l_dbus *dbus, iwd_agent_get_passphrase_cb_t get_passphrase_cb);
+// SignalLevelAgent, on the same object as the Agent. Both get the path of the device (same as its station).
+typedef void (*iwd_agent_signal_level_changed_cb_t)(const char *device_path, uint8_t level);
+typedef void (*iwd_agent_signal_level_released_cb_t)(const char *device_path); // iwd dropped the agent
+// RegisterSignalLevelAgent failed. Gets the device_name and registration given when registering.
+typedef void (*iwd_agent_signal_level_register_failed_cb_t)(const char *device_name, uint32_t registration);
+
+bool iwd_agent_init(struct l_dbus *dbus,
+                    iwd_agent_get_passphrase_cb_t get_passphrase_cb,
+                    iwd_agent_signal_level_changed_cb_t signal_level_changed_cb,
+                    iwd_agent_signal_level_released_cb_t signal_level_released_cb,
+                    iwd_agent_signal_level_register_failed_cb_t signal_level_register_failed_cb);
 void iwd_agent_deinit(struct l_dbus *dbus);
 
 bool iwd_agent_manager_register_agent(void);
 bool iwd_agent_manager_unregister_agent(void);
+void iwd_agent_manager_disconnected(void); // iwd is gone, register again when it is back
 
 bool iwd_agent_is_registered(void);
+
+// Station.RegisterSignalLevelAgent with levels in dBm, strongest first. At most IWD_SIGNAL_LEVELS_MAX.
+// device_name is the device of the station and registration tells this call from others on it. Both are given back
+// if the call fails.
+bool iwd_agent_register_signal_level_agent(struct l_dbus_proxy *proxy_station, const char *device_name,
+                                           uint32_t registration, const int16_t *levels_dbm, size_t count);
+bool iwd_agent_unregister_signal_level_agent(struct l_dbus_proxy *proxy_station);
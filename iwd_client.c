@@ -5,8 +5,11 @@
 #include "iwd_client.h"
 
 #include "iwd_agent.h"
+#include "iwd_client_internal.h"
 #include "iwd_network.h"
+#include "iwd_property.h"
 #include "iwd_proxies.h"
+#include "iwd_trace.h"
 #include "iwd_util.h"
 
 #include <stdio.h>
@@ -22,6 +25,13 @@ struct l_dbus_client *s_client;
 static iwd_client_ready_cb_t s_ready_cb;
 static iwd_client_scanning_updated_cb_t s_scanning_updated_cb;
 static iwd_client_connected_ssid_updated_cb_t s_connected_ssid_updated_cb;
+static iwd_client_known_networks_changed_cb_t s_known_networks_changed_cb; // Optional
+static iwd_client_device_ready_cb_t s_device_ready_cb; // Optional
+
+static struct l_hashmap *s_ready_devices; // device_name -> Station proxy. Devices that are ready
+
+static bool s_ready; // Between client_ready() and client_disconnected()
+static uint32_t s_known_networks_notified; // Generation last given to s_known_networks_changed_cb
 
 static void update_property_scanning(const char *device_name, bool scanning, bool startup)
 {
@@ -34,7 +44,18 @@ static void update_property_scanning(const char *device_name, bool scanning, boo
         l_info("iwd_client: Scan %s on %s", scanning ? "started" : "finished", device_name);
     }
 
-    s_scanning_updated_cb(device_name, scanning, startup);
+    if (!startup && iwd_client_station_events_coalesced()) {
+        iwd_client_station_events_changed(device_name, IWD_STATION_CHANGED_SCANNING);
+    }
+    else {
+        s_scanning_updated_cb(device_name, scanning, startup);
+    }
+
+    if (!scanning) {
+        // Scan finished (or not running at startup). Get the result into the cache.
+        iwd_client_ordered_networks_cache_refresh(device_name);
+        iwd_client_scan_networks_scan_finished(device_name);
+    }
 }
 
 static void update_property_state(const char *device_name, const char *state, bool startup)
@@ -53,8 +74,16 @@ static void update_property_state(const char *device_name, const char *state, bo
         l_info("iwd_client: State on %s changed to '%s'", device_name, state);
     }
 
-    // No callback for this. Only logging.
+    // No callback for this. Only logging, and in the coalesced station events.
     // Use connected_ssid instead which is more of an connected or disconnected only.
+
+    if (!startup) {
+        iwd_client_connect_station_state(device_name, state); // Timeline of a connect in progress
+
+        if (iwd_client_station_events_coalesced()) {
+            iwd_client_station_events_changed(device_name, IWD_STATION_CHANGED_STATE);
+        }
+    }
 }
 
 static void update_property_connected_network(const char *device_name,
@@ -63,16 +92,22 @@ static void update_property_connected_network(const char *device_name,
 {
     assert(device_name);
 
+    if (!startup) {
+        iwd_client_connect_connected_network(device_name, connected_path); // Timeline of a connect in progress
+        iwd_client_scan_schedule_connected_network(device_name, connected_path);
+    }
+
     const char *ssid = NULL;
 
     if (connected_path) {
-        struct l_dbus_proxy *connected_proxy = iwd_proxies_get_network(connected_path);
-        if (connected_proxy == NULL) {
+        const iwd_proxy_props_t *connected_props = iwd_proxies_get_props_by_path(IWD_PROXY_NETWORK, connected_path);
+        if (connected_props == NULL) {
             l_warn("iwd_client: Connected path=Can't find network proxy at path='%s'", connected_path);
             return;
         }
 
-        if (!l_dbus_proxy_get_property(connected_proxy, "Name", "s", &ssid)) {
+        ssid = connected_props->name;
+        if (ssid == NULL) {
             l_warn("iwd_client: Can't get 'Name' property of connected network at path='%s'", connected_path);
             return;
         }
@@ -95,11 +130,54 @@ static void update_property_connected_network(const char *device_name,
         }
     }
 
-    s_connected_ssid_updated_cb(device_name, ssid, startup);
+    iwd_client_snapshot_changed();
+
+    if (!startup && iwd_client_station_events_coalesced()) {
+        iwd_client_station_events_changed(device_name, IWD_STATION_CHANGED_CONNECTED_NETWORK);
+    }
+    else {
+        s_connected_ssid_updated_cb(device_name, ssid, startup);
+    }
+}
+
+//
+// KnownNetworks changes
+//
+
+// Called after every proxy change. Not during the startup burst of proxies, client_ready() notifies once instead.
+static void known_networks_notify(void)
+{
+    if (!s_ready) {
+        return;
+    }
+
+    uint32_t generation = iwd_proxies_get_generation(IWD_PROXY_KNOWN_NETWORK);
+    if (generation == s_known_networks_notified) {
+        return;
+    }
+
+    s_known_networks_notified = generation;
+    iwd_client_snapshot_changed();
+
+    if (s_known_networks_changed_cb) {
+        s_known_networks_changed_cb(generation);
+    }
+}
+
+uint32_t iwd_client_known_networks_generation(void)
+{
+    return iwd_proxies_get_generation(IWD_PROXY_KNOWN_NETWORK);
+}
+
+void iwd_client_set_known_networks_changed_cb(iwd_client_known_networks_changed_cb_t known_networks_changed_cb)
+{
+    s_known_networks_changed_cb = known_networks_changed_cb;
+    s_known_networks_notified = iwd_proxies_get_generation(IWD_PROXY_KNOWN_NETWORK);
 }
 
 // Called for each Station in client_ready(), eg. at startup
-static void each_station_on_ready(struct l_dbus_proxy *proxy, __attribute__((unused)) void *user_data)
+static void each_station_on_ready(struct l_dbus_proxy *proxy, const iwd_proxy_props_t *props,
+                                  __attribute__((unused)) void *user_data)
 {
     // Grab properties for Station
 
@@ -108,23 +186,63 @@ static void each_station_on_ready(struct l_dbus_proxy *proxy, __attribute__((unu
         return;
     }
 
-    // Scanning
-    bool scanning;
-    if (l_dbus_proxy_get_property(proxy, "Scanning", "b", &scanning)) {
-        update_property_scanning(device_name, scanning, /*startup=*/true);
+    update_property_scanning(device_name, props->scanning, /*startup=*/true);
+    update_property_state(device_name, props->state ? props->state : "unknown", /*startup=*/true);
+    update_property_connected_network(device_name,
+                                      props->connected_path, // If connected_path == NULL -> Disconnected
+                                      /*startup=*/true);
+}
+
+//
+// Device readiness
+// A device is ready as soon as both its Device and Station proxies exist, without waiting for client_ready()
+//
+
+// Device name of a Device or Station proxy
+static const char *device_name_of(struct l_dbus_proxy *proxy, const iwd_proxy_props_t *props)
+{
+    if (props->kind == IWD_PROXY_DEVICE) {
+        return props->name;
     }
+    return iwd_proxies_get_device_name_for_station(proxy);
+}
 
-    // State
-    const char *state = "unknown";
-    l_dbus_proxy_get_property(proxy, "State", "s", &state);
-    update_property_state(device_name, state, /*startup=*/true);
+static void device_ready_check(struct l_dbus_proxy *proxy, const iwd_proxy_props_t *props)
+{
+    const char *device_name = device_name_of(proxy, props);
+    if (device_name == NULL || l_hashmap_lookup(s_ready_devices, device_name)) {
+        return;
+    }
 
-    // ConnectedNetwork
-    const char *connected_path = NULL;
-    l_dbus_proxy_get_property(proxy, "ConnectedNetwork", "o", &connected_path);
-    update_property_connected_network(device_name,
-                                      connected_path, // If connected_path == NULL -> Disconnected
-                                      /*startup=*/true);
+    struct l_dbus_proxy *proxy_station = iwd_proxies_get_station_for_device(device_name);
+    if (proxy_station == NULL) {
+        return; // Station is not added yet
+    }
+
+    l_hashmap_insert(s_ready_devices, device_name, proxy_station);
+    l_info("iwd_client: Device %s is ready", device_name);
+
+    if (s_ready) {
+        // Added after client_ready(). Give it the startup values, as the other devices got in client_ready().
+        each_station_on_ready(proxy_station, iwd_proxies_get_props(proxy_station), NULL);
+    }
+
+    iwd_client_scan_schedule_device_ready(device_name);
+    iwd_client_signal_level_device_ready(device_name);
+
+    if (s_device_ready_cb) {
+        s_device_ready_cb(device_name);
+    }
+}
+
+bool iwd_client_is_ready(void)
+{
+    return s_ready;
+}
+
+void iwd_client_set_device_ready_cb(iwd_client_device_ready_cb_t device_ready_cb)
+{
+    s_device_ready_cb = device_ready_cb;
 }
 
 static void client_connected(__attribute__((unused)) struct l_dbus *dbus, __attribute__((unused)) void *user_data)
@@ -139,7 +257,16 @@ static void client_connected(__attribute__((unused)) struct l_dbus *dbus, __attr
 static void client_disconnected(__attribute__((unused)) struct l_dbus *dbus, __attribute__((unused)) void *user_data)
 {
     l_error("iwd_client: Disconnected from iwd");
+    iwd_agent_manager_disconnected();
+    l_hashmap_destroy(s_ready_devices, NULL);
+    s_ready_devices = l_hashmap_string_new();
+    iwd_client_scan_schedule_clear();
+    iwd_client_signal_level_clear();
     iwd_proxies_clear();
+    known_networks_notify(); // All are gone
+    s_ready = false;
+    iwd_client_ordered_networks_cache_clear();
+    iwd_client_snapshot_seed_cache(); // The last saved networks are served as stale until iwd is back
 }
 
 static void client_ready(__attribute__((unused)) struct l_dbus_client *client, __attribute__((unused)) void *user_data)
@@ -147,11 +274,15 @@ static void client_ready(__attribute__((unused)) struct l_dbus_client *client, _
     // All proxies are now created
     l_debug("iwd_client: Client is DBUS ready (proxies all created)");
 
-    iwd_agent_manager_register_agent();
+    iwd_agent_manager_register_agent(); // Normally already done when the AgentManager was added
 
     // Grab station properties
     iwd_proxies_foreach_station(each_station_on_ready, NULL);
 
+    s_ready = true;
+    known_networks_notify();
+    iwd_client_snapshot_changed(); // First live snapshot
+
     // Run the ready callback
     s_ready_cb();
 }
@@ -161,28 +292,59 @@ static void proxy_added(struct l_dbus_proxy *proxy, __attribute__((unused)) void
     const char *interface = l_dbus_proxy_get_interface(proxy);
     const char *path = l_dbus_proxy_get_path(proxy);
 
-    l_debug("iwd_client: proxy added: %s %s", path, interface);
+    iwd_trace_record(IWD_TRACE_PROXY_ADDED, interface, path, NULL, 0);
+    IWD_HOT_DEBUG("iwd_client: proxy added: %s %s", path, interface);
 
     iwd_proxies_add(proxy);
+    known_networks_notify();
+
+    const iwd_proxy_props_t *props = iwd_proxies_get_props(proxy);
+    if (props && props->kind == IWD_PROXY_AGENT_MANAGER) {
+        iwd_agent_manager_register_agent(); // Early, so connects can be done as soon as a device is ready
+    }
+    else if (props && (props->kind == IWD_PROXY_DEVICE || props->kind == IWD_PROXY_STATION)) {
+        device_ready_check(proxy, props);
+    }
 }
 
 static void proxy_removed(struct l_dbus_proxy *proxy, __attribute__((unused)) void *user_data)
 {
-    l_debug("iwd_client: proxy removed: %s %s", l_dbus_proxy_get_path(proxy),
-            l_dbus_proxy_get_interface(proxy));
+    iwd_trace_record(IWD_TRACE_PROXY_REMOVED, l_dbus_proxy_get_interface(proxy), l_dbus_proxy_get_path(proxy),
+                     NULL, 0);
+    IWD_HOT_DEBUG("iwd_client: proxy removed: %s %s", l_dbus_proxy_get_path(proxy),
+                  l_dbus_proxy_get_interface(proxy));
+
+    const iwd_proxy_props_t *props = iwd_proxies_get_props(proxy);
+    if (props && (props->kind == IWD_PROXY_DEVICE || props->kind == IWD_PROXY_STATION)) {
+        const char *device_name = device_name_of(proxy, props);
+        if (device_name && l_hashmap_remove(s_ready_devices, device_name)) {
+            l_info("iwd_client: Device %s is gone", device_name);
+            iwd_client_scan_schedule_device_gone(device_name);
+            iwd_client_signal_level_device_gone(device_name);
+            iwd_client_ordered_networks_cache_device_gone(device_name);
+            iwd_client_diagnostics_device_gone(device_name);
+        }
+    }
 
     iwd_proxies_remove(proxy);
+    known_networks_notify();
 }
 
 static void property_changed(struct l_dbus_proxy *proxy, const char *name,
                 struct l_dbus_message *msg, __attribute__((unused)) void *user_data)
 {
     const char *path = l_dbus_proxy_get_path(proxy);
-    const char *interface = l_dbus_proxy_get_interface(proxy);
 
-    l_debug("iwd_client: property changed: %s (%s %s)", name, path, interface);
+    iwd_trace_record(IWD_TRACE_PROPERTY, name, path, l_dbus_proxy_get_interface(proxy), 0);
+    IWD_HOT_DEBUG("iwd_client: property changed: %s (%s %s)", name, path, l_dbus_proxy_get_interface(proxy));
+
+    iwd_property_t property = iwd_property_lookup(name);
 
-    if (!streq(interface, "net.connman.iwd.Station")) {
+    iwd_proxies_property_changed(proxy, property);
+    known_networks_notify();
+
+    const iwd_proxy_props_t *props = iwd_proxies_get_props(proxy);
+    if (props == NULL || props->kind != IWD_PROXY_STATION) {
         // We are only interested in Station changes
         return;
     }
@@ -193,59 +355,51 @@ static void property_changed(struct l_dbus_proxy *proxy, const char *name,
         return;
     }
 
-    if (streq(name, "Scanning")) {
-        bool scanning;
-        if (!l_dbus_message_get_arguments(msg, "b", &scanning)) {
-            return;
+    // The new value is already decoded into props
+    switch (property) {
+    case IWD_PROPERTY_SCANNING:
+        if (msg == NULL) {
+            return; // Invalidated
         }
-        update_property_scanning(device_name, scanning, /*startup=*/false);
-    }
-    else if (streq(name, "State")) {
-        const char *state = "unknown";
-        l_dbus_message_get_arguments(msg, "s", &state);
-        update_property_state(device_name, state, /*startup=*/false);
-    }
-    else if (streq(name, "ConnectedNetwork")) {
-        const char *connected_path = NULL;
-        l_dbus_message_get_arguments(msg, "o", &connected_path);
+        update_property_scanning(device_name, props->scanning, /*startup=*/false);
+        break;
+
+    case IWD_PROPERTY_STATE:
+        update_property_state(device_name, props->state ? props->state : "unknown", /*startup=*/false);
+        break;
+
+    case IWD_PROPERTY_CONNECTED_NETWORK:
         update_property_connected_network(device_name,
-                                          connected_path, // If connected_path == NULL -> Disconnected
+                                          props->connected_path, // If connected_path == NULL -> Disconnected
                                           /*startup=*/false);
+        break;
+
+    default:
+        break;
     }
 }
 
 //
 // KnownNetworks
-// This call is NOT async
+// The table is the KnownNetwork proxies, kept up to date by iwd_proxies. This call is NOT async.
 //
 
-static void each_known_network(struct l_dbus_proxy *proxy, void *user_data)
+static void each_known_network(__attribute__((unused)) struct l_dbus_proxy *proxy, const iwd_proxy_props_t *props,
+                               void *user_data)
 {
     struct l_queue *list = user_data;
 
-    const char *path = l_dbus_proxy_get_path(proxy);
-
-    const char *name = NULL;
-    if (!l_dbus_proxy_get_property(proxy, "Name", "s", &name)) {
-        l_warn("iwd_client: Can't get 'Name' property of known network at path='%s'", path);
-        return;
-    }
-
-    const char *type = NULL;
-    if (!l_dbus_proxy_get_property(proxy, "Type", "s", &type)) {
-        l_warn("iwd_client: Can't get 'Type' property of known network at path='%s'", path);
+    if (props->name == NULL) {
+        l_warn("iwd_client: Can't get 'Name' property of known network at path='%s'", props->path);
         return;
     }
 
-    bool hidden = false;
-    if (!l_dbus_proxy_get_property(proxy, "Hidden", "b", &hidden)) {
-       l_warn("iwd_client: Can't get 'Hidden' property of known network at path='%s'", path);
-       return;
-    }
+    const char *type = iwd_security_to_string(props->security);
 
-    l_debug("iwd_client: KnownNetwork type=%s hidden=%u name=%-32s path=%s", type, hidden, name, path);
+    l_debug("iwd_client: KnownNetwork type=%s hidden=%u name=%-32s path=%s", type, props->hidden, props->name,
+            props->path);
 
-    iwd_known_network_t *known_network = iwd_known_network_create(name, type, hidden, path);
+    iwd_known_network_t *known_network = iwd_known_network_create(props->name, type, props->hidden, props->path);
     l_queue_push_tail(list, known_network);
 }
 
@@ -262,9 +416,6 @@ struct l_queue *iwd_client_known_networks(void)
 // Init/Deinit
 //
 
-// Exists in iwd_client_connect.c
-const char *iwd_client_connect_agent_get_passphrase(const char *network_path);
-
 bool iwd_client_init(struct l_dbus *dbus,
                      iwd_client_ready_cb_t ready_cb,
                      iwd_client_scanning_updated_cb_t scanning_updated_cb,
@@ -280,9 +431,23 @@ bool iwd_client_init(struct l_dbus *dbus,
     s_connected_ssid_updated_cb = connected_ssid_updated_cb;
 
 
+    iwd_trace_init();
     iwd_proxies_init();
-
-    iwd_agent_init(dbus, iwd_client_connect_agent_get_passphrase);
+    s_ready_devices = l_hashmap_string_new();
+    iwd_client_ordered_networks_cache_init();
+    iwd_client_snapshot_seed_cache();
+    iwd_client_ordered_networks_delta_init();
+    iwd_client_scan_init();
+    iwd_client_connect_init();
+    iwd_client_scan_networks_init();
+    iwd_client_station_events_init();
+    iwd_client_scan_schedule_init();
+    iwd_client_signal_level_init();
+    iwd_client_diagnostics_init();
+
+    iwd_agent_init(dbus, iwd_client_connect_agent_get_passphrase,
+                   iwd_client_signal_level_agent_changed, iwd_client_signal_level_agent_released,
+                   iwd_client_signal_level_agent_register_failed);
 
     // Connect to iwd
     s_client = l_dbus_client_new(dbus, "net.connman.iwd", "");
@@ -308,5 +473,17 @@ void iwd_client_deinit(struct l_dbus *dbus)
     l_dbus_client_destroy(s_client);
 
     // Must be after l_dbus_client_destroy() as it will call disconnect callback which will try to clear the iwd proxies
+    iwd_client_diagnostics_deinit();
+    iwd_client_signal_level_deinit();
+    iwd_client_scan_schedule_deinit();
+    iwd_client_station_events_deinit();
+    iwd_client_scan_networks_deinit();
+    iwd_client_scan_deinit();
+    iwd_client_connect_deinit();
+    iwd_client_ordered_networks_cache_deinit();
+    iwd_client_ordered_networks_delta_deinit();
+    l_hashmap_destroy(s_ready_devices, NULL);
+    s_ready_devices = NULL;
     iwd_proxies_deinit();
+    iwd_trace_deinit();
 }
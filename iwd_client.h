@@ -4,7 +4,9 @@
 //****************************************************************************
 #pragma once
 
+#include "iwd_diagnostic.h"
 #include "iwd_network.h"
+#include "iwd_stats.h"
 #include "iwd_status.h"
 
 #include <ell/ell.h>
@@ -24,11 +26,50 @@ bool iwd_client_init(struct l_dbus *dbus,
                      iwd_client_connected_ssid_updated_cb_t connected_ssid_updated_cb);
 void iwd_client_deinit(struct l_dbus *dbus);
 
+// Optional, set before iwd_client_init() to also get the devices at startup.
+// Called as soon as both the Device and the Station of a device exist. At startup that is before ready_cb,
+// and it is also called for devices that are added later. Scans and connects can be done on the device from here.
+// Known networks are filled in as they are added, see iwd_client_known_networks_generation().
+typedef void (*iwd_client_device_ready_cb_t)(const char *device_name);
+void iwd_client_set_device_ready_cb(iwd_client_device_ready_cb_t device_ready_cb);
+
+// Optional coalescing of station property changes. Instead of calling scanning_updated_cb and
+// connected_ssid_updated_cb for every change, the changes of a device are gathered during window_ms from the first
+// change (0 = until the main loop is idle) and delivered as one event with the values at the end of the window.
+// Startup values are still given to scanning_updated_cb and connected_ssid_updated_cb. NULL goes back to those.
+typedef enum {
+    IWD_STATION_CHANGED_SCANNING = 1 << 0,
+    IWD_STATION_CHANGED_STATE = 1 << 1,
+    IWD_STATION_CHANGED_CONNECTED_NETWORK = 1 << 2,
+} iwd_station_changed_t;
+
+typedef struct {
+    const char *device_name;
+    uint32_t changed; // iwd_station_changed_t bits of what changed during the window. Might be back to same value.
+    bool scanning;
+    const char *state; // See update_property_state() in iwd_client.c
+    const char *connected_ssid; // NULL means disconnected
+} iwd_station_event_t;
+
+typedef void (*iwd_client_station_event_cb_t)(const iwd_station_event_t *event);
+void iwd_client_set_station_event_cb(uint32_t window_ms, iwd_client_station_event_cb_t station_event_cb);
+
 struct l_queue *iwd_client_known_networks(void); // Returns l_queue list of iwd_known_network_t
 
+// The known networks are kept up to date from iwd signals. The generation changes every time a known network
+// is added, removed or changed, so a caller can skip rebuilding the list when it has not changed.
+uint32_t iwd_client_known_networks_generation(void);
+
+// Optional. Called with the new generation when the known networks have changed. NULL to stop.
+// Not called for each known network at startup, but once when the client is ready.
+typedef void (*iwd_client_known_networks_changed_cb_t)(uint32_t generation);
+void iwd_client_set_known_networks_changed_cb(iwd_client_known_networks_changed_cb_t known_networks_changed_cb);
+
 // Callbacks will always be called, even on any error.
 // This means that early errors can have the callback executed even before the _async() call has returned.
 
+// Scans on the same device are coalesced. If a Scan is already called, or a scan is already running,
+// the callback gets the result of that one instead of starting a new scan.
 typedef void (*iwd_client_scan_started_cb_t)(iwd_status_t status, void *user_data);
 bool iwd_client_scan_start_async(const char *device_name,
                                  iwd_client_scan_started_cb_t scan_started_cb,
@@ -39,10 +80,101 @@ bool iwd_client_ordered_networks_async(const char *device_name,
                                        iwd_client_ordered_networks_done_cb_t ordered_networks_done_cb,
                                        void *user_data);
 
+// Same as iwd_client_ordered_networks_async(), but the networks are packed in one allocation.
+// Free with iwd_network_packed_destroy(). networks is NULL on error. The cache is not updated by this call.
+typedef void (*iwd_client_ordered_networks_packed_done_cb_t)(iwd_status_t status,
+                                                             iwd_network_packed_t *networks,
+                                                             void *user_data);
+bool iwd_client_ordered_networks_packed_async(const char *device_name,
+                                              iwd_client_ordered_networks_packed_done_cb_t ordered_networks_done_cb,
+                                              void *user_data);
+
+// Same as iwd_client_ordered_networks_async(), but the callback gets a read-only array of views pointing into
+// the DBUS reply and the proxy properties. Nothing is copied. The views are only valid during the callback,
+// use iwd_network_from_view() or iwd_network_list_from_views() to keep them. The cache is not updated by this call.
+typedef void (*iwd_client_ordered_networks_view_done_cb_t)(iwd_status_t status,
+                                                           const iwd_network_view_t *networks,
+                                                           size_t count,
+                                                           void *user_data);
+bool iwd_client_ordered_networks_view_async(const char *device_name,
+                                            iwd_client_ordered_networks_view_done_cb_t ordered_networks_done_cb,
+                                            void *user_data);
+
+// The ordered networks of the device are cached. The cache is refreshed every time a scan finishes and
+// on every iwd_client_ordered_networks_async(), which is the way to force a refresh.
+// Returns l_queue list of iwd_network_t owned by iwd_client, or NULL if nothing is fetched yet.
+// Do not modify or free the list or its networks. It must not be kept, it is only valid until control is
+// returned to the main loop.
+// generation (can be NULL) is set to a number that changes every time the list is replaced. 0 if no list.
+struct l_queue *iwd_client_ordered_networks_cached(const char *device_name, uint32_t *generation);
+
+// Optional. Called with what has changed every time the cache of a device is replaced, compared with what was
+// last reported for the device. An RSSI change is only reported once it has moved at least rssi_threshold100
+// (100 * dB) from the last reported RSSI. Not called if nothing changed. The deltas are only valid during the
+// callback. Setting the callback starts over, so the next result of each device is reported as all added.
+typedef void (*iwd_client_ordered_networks_delta_cb_t)(const char *device_name,
+                                                       const iwd_network_delta_t *deltas,
+                                                       size_t count);
+void iwd_client_set_ordered_networks_delta_cb(uint16_t rssi_threshold100,
+                                              iwd_client_ordered_networks_delta_cb_t delta_cb);
+
+// True if the cached networks of the device are from the snapshot (see below) and not yet from iwd
+bool iwd_client_ordered_networks_cache_is_stale(const char *device_name);
+
+// Scan and get the ordered networks when the scan is done, as one operation.
+// A scan that is already running is used instead of starting a new one. The networks are those of the cache
+// refresh that follows the scan, so there is no GetOrderedNetworks of its own unless that refresh fails.
+// The callback gets IWD_STATUS_TIMEOUT if the networks are not fetched within timeout_ms (must be > 0).
+bool iwd_client_scan_ordered_networks_async(const char *device_name,
+                                            uint32_t timeout_ms,
+                                            iwd_client_ordered_networks_done_cb_t ordered_networks_done_cb,
+                                            void *user_data);
+
+// Scan and get the ordered networks on all stations at once, as iwd_client_scan_ordered_networks_async().
+// The networks of all devices are merged by SSID and security into one l_queue list of iwd_survey_network_t,
+// strongest first, with the RSSI on each device that saw it. Free with iwd_survey_network_list_destroy().
+// Succeeds if at least one device succeeded. Otherwise the status is that of the first device that failed.
+typedef void (*iwd_client_survey_done_cb_t)(iwd_status_t status, struct l_queue *networks, void *user_data);
+bool iwd_client_survey_async(uint32_t timeout_ms,
+                             iwd_client_survey_done_cb_t survey_done_cb,
+                             void *user_data);
+
+// Optional background scans on every ready device, instead of a scan timer in each application.
+// Scans every disconnected_interval_ms while disconnected. While connected the interval starts at
+// connected_min_interval_ms and is doubled after each scan where the connected network is strong, up to
+// connected_max_interval_ms. Back to connected_min_interval_ms when the RSSI is at or below weak_rssi100, or has
+// dropped at least falling_rssi100 since the last scan. Any finished scan, also those not started by the scheduler,
+// restarts the interval. No scans while a connect is in flight. The results are put in the ordered networks cache.
+// Start after iwd_client_init(). Starting again replaces the schedule.
+typedef struct {
+    uint32_t disconnected_interval_ms;
+    uint32_t connected_min_interval_ms;
+    uint32_t connected_max_interval_ms;
+    int16_t weak_rssi100; // 100 * dBm
+    uint16_t falling_rssi100; // 100 * dB, > 0
+} iwd_scan_schedule_t;
+void iwd_client_scan_schedule_start(const iwd_scan_schedule_t *schedule);
+void iwd_client_scan_schedule_stop(void);
+
+// Optional signal level of the connected network, pushed by iwd instead of polling the ordered networks.
+// thresholds_rssi100 are 100 * dBm, strongest first, at most IWD_SIGNAL_LEVELS_MAX. iwd takes whole dBm, so they
+// must be at least 1 dBm apart. Called with the new level each time the RSSI crosses a threshold while connected.
+// The level is the number of thresholds above the RSSI: 0 at or above thresholds_rssi100[0], count below all.
+// Set per device after iwd_client_init(), also before the device is ready. Kept when the device or iwd comes back.
+// NULL callback stops. Returns false on invalid thresholds, keeping what was set before.
+#define IWD_SIGNAL_LEVELS_MAX 16
+typedef void (*iwd_client_signal_level_cb_t)(const char *device_name, uint8_t level);
+bool iwd_client_set_signal_level_cb(const char *device_name,
+                                    const int16_t *thresholds_rssi100,
+                                    size_t count,
+                                    iwd_client_signal_level_cb_t signal_level_cb);
+
 typedef enum {
     IWD_CONNECT_NOT_HIDDEN = false,
     IWD_CONNECT_HIDDEN = true,
     IWD_CONNECT_AUTO_HIDDEN = 2, // Will try with hidden if SSID wasn't found as a Network
+    IWD_CONNECT_AUTO_SCAN_HIDDEN = 3, // If SSID isn't found as a Network, scans (see below) and looks again
+                                      // before trying with hidden
 } iwd_connect_hidden_t;
 
 typedef void (*iwd_client_connect_done_cb_t)(iwd_status_t status, void *user_data);
@@ -53,7 +185,49 @@ bool iwd_client_connect(const char *device_name,
                         iwd_client_connect_done_cb_t connect_done_cb,
                         void *user_data);
 
+// Time budget of the scan done by IWD_CONNECT_AUTO_SCAN_HIDDEN. Must be > 0. Default is 5000 ms.
+void iwd_client_set_connect_scan_budget_ms(uint32_t budget_ms);
+
+// Timelines of the last IWD_CONNECT_TIMELINES connects, newest first. Returns number of timelines copied.
+size_t iwd_client_connect_timelines(iwd_connect_timeline_t *timelines, size_t max);
+// Histograms of the connect phases, over all connects since start
+void iwd_client_connect_stats(iwd_connect_stats_t *stats);
+
 typedef void (*iwd_client_forget_done_cb_t)(iwd_status_t status, void *user_data);
 bool iwd_client_forget(const char *ssid,
                        iwd_client_forget_done_cb_t forget_done_cb,
                        void *user_data);
+
+// Optional warm-start snapshot, saved to path after a change of the networks, the known networks or the connected
+// network, at most every 30 s. A change of only the signal of the networks is not saved. Open before
+// iwd_client_init(), which puts the saved ordered networks in the cache as stale until live ones replace them, and
+// again after each reconnect to iwd. Returns false if there was no usable snapshot to load. Saving is enabled anyway.
+bool iwd_client_snapshot_open(const char *path);
+void iwd_client_snapshot_close(void); // After iwd_client_deinit()
+// From the last snapshot, loaded or saved. NULL if not connected, or no snapshot.
+// Only valid until control is returned to the main loop, a save replaces it.
+const char *iwd_client_snapshot_connected_ssid(const char *device_name);
+// From the last snapshot, loaded or saved. Returns l_queue list of iwd_known_network_t, or NULL if no snapshot.
+struct l_queue *iwd_client_snapshot_known_networks(void);
+
+// Optional sampling of StationDiagnostic.GetDiagnostics on every connected station, every interval_ms.
+// The last capacity samples of each device are kept in a ring allocated once per device. Start after
+// iwd_client_init(). Starting again clears all samples, and a device that goes away loses its samples. Stop keeps
+// the samples for reading.
+void iwd_client_diagnostics_start(uint32_t interval_ms, size_t capacity);
+void iwd_client_diagnostics_stop(void);
+// Copies the samples of the device taken at or after since_usec (l_time_now() time, 0 for all), newest first.
+// Returns number of samples copied.
+size_t iwd_client_diagnostics_window(const char *device_name, uint64_t since_usec,
+                                     iwd_diagnostic_sample_t *samples, size_t max);
+// Min, avg and max over the same samples as iwd_client_diagnostics_window(). False if the device was never sampled.
+bool iwd_client_diagnostics_summary(const char *device_name, uint64_t since_usec,
+                                    iwd_diagnostic_summary_t *summary);
+
+// Flight recorder of the last DBUS calls, replies, errors, property changes and agent requests.
+// Formats the records oldest first, one line each, and gives them to line_cb. Replies have the time since the call.
+typedef void (*iwd_client_trace_line_cb_t)(const char *line, void *user_data);
+void iwd_client_trace_dump(iwd_client_trace_line_cb_t line_cb, void *user_data);
+
+// Counters and latency histograms of all scan, ordered networks, connect and forget operations since start
+void iwd_client_stats_get(iwd_client_stats_t *stats);
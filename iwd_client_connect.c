@@ -5,7 +5,9 @@
 #include "iwd_client.h"
 
 #include "iwd_agent.h"
+#include "iwd_client_internal.h"
 #include "iwd_proxies.h"
+#include "iwd_trace.h"
 #include "iwd_util.h"
 
 #include <assert.h>
@@ -14,25 +16,52 @@
 typedef struct {
     iwd_client_connect_done_cb_t done_cb;
     void *user_data;
+    char *device_name; // Our own copy of the device we connect on
     char *network_path; // DBUS path of iwd network we are connecting to
     char *ssid; // // Our own copy of the ssid, used to setup a Hidden connect
     char *passphrase; // Our own copy of the passphrase to feed to the Agent
     bool hidden;
+    bool overridden; // Taken out of s_connect_opers by a newer connect. Freed by its own destroy handler.
+    uint32_t trace_seq; // Of the Connect or ConnectHiddenNetwork call
+    iwd_connect_timeline_t timeline;
 } connect_oper_t;
 
-// Single operation can be running
-static connect_oper_t *s_connect_oper;
+// Single operation can be running per device
+static struct l_hashmap *s_connect_opers; // device_name -> connect_oper_t. Not the overridden ones.
+
+// IWD_CONNECT_AUTO_SCAN_HIDDEN waiting for its scan before the connect
+typedef struct {
+    iwd_client_connect_done_cb_t done_cb; // NULL when overridden
+    void *user_data;
+    char *device_name;
+    char *ssid;
+    char *passphrase; // Can be NULL
+    uint64_t start_usec;
+} connect_scan_t;
+
+static struct l_hashmap *s_connect_scans; // device_name -> connect_scan_t
+static uint32_t s_connect_scan_budget_ms = 5000;
+
+// Timelines of the last connects, in a ring
+static iwd_connect_timeline_t s_timelines[IWD_CONNECT_TIMELINES];
+static unsigned int s_timelines_next;
+static unsigned int s_timelines_count;
+
+static iwd_connect_stats_t s_connect_stats;
 
 static connect_oper_t *connect_oper_create(iwd_client_connect_done_cb_t done_cb,
                                            void *user_data,
+                                           const char *device_name,
                                            const char *network_path,
                                            const char *ssid,
                                            const char *passphrase,
-                                           bool hidden)
+                                           bool hidden,
+                                           uint64_t start_usec)
 {
     connect_oper_t *oper = l_new(connect_oper_t, 1);
     oper->done_cb = done_cb;
     oper->user_data = user_data;
+    oper->device_name = l_strdup(device_name);
     oper->network_path = l_strdup(network_path);
     oper->ssid = l_strdup(ssid);
 
@@ -45,15 +74,56 @@ static connect_oper_t *connect_oper_create(iwd_client_connect_done_cb_t done_cb,
 
     oper->hidden = hidden;
 
+    l_strlcpy(oper->timeline.device_name, device_name, sizeof(oper->timeline.device_name));
+    l_strlcpy(oper->timeline.ssid, ssid, sizeof(oper->timeline.ssid));
+    oper->timeline.start_usec = start_usec;
+
     return oper;
 }
 
+// Only the first time a phase is seen is recorded
+static void connect_oper_phase(connect_oper_t *oper, iwd_connect_phase_t phase)
+{
+    if (oper->timeline.phase_usec[phase] != 0) {
+        return;
+    }
+
+    uint64_t usec = l_time_now() - oper->timeline.start_usec;
+    oper->timeline.phase_usec[phase] = usec > 0 ? usec : 1; // 0 means not seen
+
+    l_debug("iwd_client: Connect on %s reached phase %u after %u us",
+            oper->timeline.device_name, phase, oper->timeline.phase_usec[phase]);
+}
+
+static void connect_timeline_record(const iwd_connect_timeline_t *timeline)
+{
+    s_timelines[s_timelines_next] = *timeline;
+    s_timelines_next = (s_timelines_next + 1) % IWD_CONNECT_TIMELINES;
+    if (s_timelines_count < IWD_CONNECT_TIMELINES) {
+        s_timelines_count++;
+    }
+
+    for (iwd_connect_phase_t phase = 0; phase < IWD_CONNECT_PHASE_COUNT; phase++) {
+        if (timeline->phase_usec[phase] != 0) {
+            iwd_histogram_add(&s_connect_stats.phases[phase], timeline->phase_usec[phase]);
+        }
+    }
+}
+
 static void connect_oper_run_callback(connect_oper_t *oper, iwd_status_t status)
 {
     assert(oper);
     assert(oper->done_cb);
-    oper->done_cb(status, oper->user_data);
-    oper->done_cb = NULL; // Mark it called
+
+    connect_oper_phase(oper, IWD_CONNECT_PHASE_DONE);
+    oper->timeline.status = status;
+    connect_timeline_record(&oper->timeline);
+    iwd_stats_record(IWD_OPER_CONNECT, status, oper->timeline.start_usec);
+
+    // Marked called before the callback, which may start a new connect that overrides this one
+    iwd_client_connect_done_cb_t done_cb = oper->done_cb;
+    oper->done_cb = NULL;
+    done_cb(status, oper->user_data);
 }
 
 static void connect_oper_destroy(connect_oper_t *oper)
@@ -66,6 +136,7 @@ static void connect_oper_destroy(connect_oper_t *oper)
         connect_oper_run_callback(oper, IWD_STATUS_DBUS_ABORTED);
     }
 
+    l_free(oper->device_name);
     l_free(oper->network_path);
     l_free(oper->ssid);
     l_free(oper->passphrase);
@@ -78,7 +149,12 @@ static void connect_oper_error_and_destroy(connect_oper_t *oper, iwd_status_t st
     connect_oper_destroy(oper);
 }
 
-static void connect_reply_handler(__attribute__((unused)) struct l_dbus_proxy *unused_proxy,
+typedef struct {
+    const char *network_path;
+    connect_oper_t *found;
+} connect_oper_find_t;
+
+static void connect_reply_handler(struct l_dbus_proxy *proxy,
                                   struct l_dbus_message *msg,
                                   void *user_data)
 {
@@ -86,12 +162,15 @@ static void connect_reply_handler(__attribute__((unused)) struct l_dbus_proxy *u
 
     connect_oper_t *oper = (connect_oper_t *)user_data;
     assert(oper);
-    assert(oper->done_cb);
 
-    if (oper != s_connect_oper) { // Make sure its our oper
-        l_warn("iwd_client: Got connect_reply_handler() for incorrect/old oper data?");
+    // Also an overridden oper is alive until its destroy handler
+    iwd_trace_reply(proxy, oper->hidden ? "ConnectHiddenNetwork" : "Connect", msg, oper->trace_seq);
+
+    if (oper->overridden) {
+        l_warn("iwd_client: Got connect_reply_handler() for an overridden connect on %s", oper->device_name);
         return;
     }
+    assert(oper->done_cb);
 
     if (l_dbus_message_is_error(msg)) {
         const char *name = "";
@@ -129,50 +208,127 @@ static void connect_destroy_handler(void *user_data)
     connect_oper_t *oper = (connect_oper_t *)user_data;
     assert(oper);
 
-    if (oper != s_connect_oper) { // Make sure its our oper we destroy
-        l_warn("iwd_client: Got connect_destroy_handler() for incorrect/old oper data?");
-        return;
+    // An overridden oper is already out of the map, where a newer connect on the device may be now
+    if (!oper->overridden) {
+        l_hashmap_remove(s_connect_opers, oper->device_name);
     }
-
     connect_oper_destroy(oper);
-    s_connect_oper = NULL;
+}
+
+static bool connect_oper_match_network_path(const connect_oper_t *oper, const char *network_path)
+{
+    // If it is a hidden connect, we only have the first part of the path. That of the station.
+    if (oper->hidden) {
+        size_t len = strlen(oper->network_path);
+        return strncmp(oper->network_path, network_path, len) == 0 && network_path[len] == '/';
+    }
+
+    return streq(oper->network_path, network_path);
+}
+
+static void connect_oper_find_by_network_path(__attribute__((unused)) const void *key, void *value, void *user_data)
+{
+    connect_oper_t *oper = value;
+    connect_oper_find_t *find = user_data;
+
+    if (find->found == NULL && connect_oper_match_network_path(oper, find->network_path)) {
+        find->found = oper;
+    }
 }
 
 // Called by iwd_agent
 // Internal function of iwd_client.c + iwd_client_connect.c
 // Given as callback to iwd_agent.c in iwd_client_init().
-const char *iwd_client_connect_agent_get_passphrase(const char *network_path);
-
 const char *iwd_client_connect_agent_get_passphrase(const char *network_path)
 {
     l_debug("iwd_client: connect_agent_get_passphrase() path=%s", network_path);
 
-    if (s_connect_oper == NULL) {
+    if (l_hashmap_isempty(s_connect_opers)) {
         l_error("iwd_client: Got connect_agent_get_passphrase() without any CONNECT oper in progress");
         return NULL;
     }
 
-    // Check that Agent asks for the network we are currently trying to connect to
+    // Find the connect that Agent asks for. Each device can have its own connect running.
+    connect_oper_find_t find = { .network_path = network_path };
+    l_hashmap_foreach(s_connect_opers, connect_oper_find_by_network_path, &find);
+    if (find.found == NULL) {
+        l_error("iwd_client: connect_agent_get_passphrase() asks for network=%s, "
+                "but we have no passphrase for it in any connect in progress",
+                network_path);
+        return NULL;
+    }
 
-    // If it is a hidden connect, we only have the first part of the path. That of the station.
-    if (s_connect_oper->hidden) {
-        if (strncmp(s_connect_oper->network_path, network_path, strlen(s_connect_oper->network_path)) != 0) {
-            l_error("iwd_client: connect_agent_get_passphrase() asks for hidden network=%s, "
-                    "but we have passphrase for a hidden network at station=%s",
-                    network_path, s_connect_oper->network_path);
-            return NULL;
-        }
+    connect_oper_phase(find.found, IWD_CONNECT_PHASE_PASSPHRASE);
+
+    return find.found->passphrase;
+}
+
+void iwd_client_connect_station_state(const char *device_name, const char *state)
+{
+    connect_oper_t *oper = l_hashmap_lookup(s_connect_opers, device_name);
+    if (oper == NULL) {
+        return;
     }
-    else {
-        if (!streq(s_connect_oper->network_path, network_path)) {
-            l_error("iwd_client: connect_agent_get_passphrase() asks for network=%s, "
-                    "but we have passphrase for network=%s",
-                    network_path, s_connect_oper->network_path);
-            return NULL;
-        }
+
+    if (streq(state, "connecting")) {
+        connect_oper_phase(oper, IWD_CONNECT_PHASE_CONNECTING);
+    }
+    else if (streq(state, "connected")) {
+        connect_oper_phase(oper, IWD_CONNECT_PHASE_CONNECTED);
+    }
+}
+
+void iwd_client_connect_connected_network(const char *device_name, const char *connected_path)
+{
+    connect_oper_t *oper = l_hashmap_lookup(s_connect_opers, device_name);
+    if (oper == NULL || connected_path == NULL) {
+        return;
+    }
+
+    if (connect_oper_match_network_path(oper, connected_path)) {
+        connect_oper_phase(oper, IWD_CONNECT_PHASE_CONNECTED_NETWORK);
+    }
+}
+
+size_t iwd_client_connect_timelines(iwd_connect_timeline_t *timelines, size_t max)
+{
+    size_t count = 0;
+
+    // Newest first
+    unsigned int index = s_timelines_next;
+    while (count < max && count < s_timelines_count) {
+        index = (index + IWD_CONNECT_TIMELINES - 1) % IWD_CONNECT_TIMELINES;
+        timelines[count++] = s_timelines[index];
     }
 
-    return s_connect_oper->passphrase;
+    return count;
+}
+
+void iwd_client_connect_stats(iwd_connect_stats_t *stats)
+{
+    *stats = s_connect_stats;
+}
+
+bool iwd_client_connect_in_progress(const char *device_name)
+{
+    return l_hashmap_lookup(s_connect_opers, device_name) || l_hashmap_lookup(s_connect_scans, device_name);
+}
+
+void iwd_client_connect_init(void)
+{
+    s_connect_opers = l_hashmap_string_new();
+    s_connect_scans = l_hashmap_string_new();
+}
+
+void iwd_client_connect_deinit(void)
+{
+    // All opers are destroyed together with the DBUS client, which takes them out of the map
+    l_hashmap_destroy(s_connect_opers, NULL);
+    s_connect_opers = NULL;
+
+    // Scans are already completed by iwd_client_scan_networks_deinit(), which freed them
+    l_hashmap_destroy(s_connect_scans, NULL);
+    s_connect_scans = NULL;
 }
 
 static void connect_setup_handler(struct l_dbus_message *message,
@@ -191,35 +347,33 @@ static void connect_setup_handler(struct l_dbus_message *message,
     }
 }
 
-bool iwd_client_connect(const char *device_name,
-                        const char *ssid,
-                        const char *passphrase, // Allowed to be NULL for open wifi
-                        iwd_connect_hidden_t hidden,
-                        iwd_client_connect_done_cb_t connect_done_cb,
-                        void *user_data)
+static bool connect_start(const char *device_name,
+                          const char *ssid,
+                          const char *passphrase,
+                          iwd_connect_hidden_t hidden,
+                          iwd_client_connect_done_cb_t connect_done_cb,
+                          void *user_data,
+                          uint64_t start_usec)
 {
-    assert(connect_done_cb);
-    assert(ssid);
-
-    l_info("iwd_client: Connecting to ssid='%s' on %s", ssid, device_name);
-
     if (!iwd_agent_is_registered()) {
         l_error("iwd_client: Agent is not registered. Trying to connect anyway");
     }
 
     bool do_hidden = false;
     struct l_dbus_proxy *proxy = NULL;
-    if (hidden != IWD_CONNECT_HIDDEN) { // NotHidden + Auto
+    if (hidden != IWD_CONNECT_HIDDEN) { // NotHidden + Auto + AutoScan
         proxy = iwd_proxies_get_network_for_ssid(device_name, ssid);
     }
     if (proxy == NULL) {
         switch (hidden) {
         case IWD_CONNECT_NOT_HIDDEN:
             l_error("iwd_client: Network for ssid='%s' is not found on '%s", ssid, device_name);
+            iwd_stats_record(IWD_OPER_CONNECT, IWD_STATUS_NETWORK_NOT_FOUND, start_usec);
             connect_done_cb(IWD_STATUS_NETWORK_NOT_FOUND, user_data);
             return false;
 
         case IWD_CONNECT_AUTO_HIDDEN:
+        case IWD_CONNECT_AUTO_SCAN_HIDDEN: // The scan is already done
             l_info("iwd_client: Network for ssid='%s' is not found on '%s'. Trying with a Hidden connect",
                     ssid, device_name);
             // fall through
@@ -228,6 +382,7 @@ bool iwd_client_connect(const char *device_name,
             proxy = iwd_proxies_get_station_for_device(device_name);
             if (!proxy) {
                 l_error("iwd_client: Station for '%s' not found", device_name);
+                iwd_stats_record(IWD_OPER_CONNECT, IWD_STATUS_STATION_NOT_FOUND, start_usec);
                 connect_done_cb(IWD_STATUS_STATION_NOT_FOUND, user_data);
                 return false;
             }
@@ -236,19 +391,24 @@ bool iwd_client_connect(const char *device_name,
         }
     }
 
-    if (s_connect_oper) {
-        l_warn("iwd_client: Another Connect is already started. Overriding");
-        // Always override the existing operation in order to not block new operations if the old failed somehow
-        connect_oper_error_and_destroy(s_connect_oper, IWD_STATUS_CONNECT_OVERRIDEN);
-        s_connect_oper = NULL;
+    connect_oper_t *old_oper = l_hashmap_remove(s_connect_opers, device_name);
+    if (old_oper) {
+        l_warn("iwd_client: Another Connect is already started on %s. Overriding", device_name);
+        // Always override the existing operation in order to not block new operations if the old failed somehow.
+        // It is kept until its DBUS call is done, as its reply and destroy handlers still get it.
+        old_oper->overridden = true;
+        if (old_oper->done_cb) {
+            connect_oper_run_callback(old_oper, IWD_STATUS_CONNECT_OVERRIDEN);
+        }
     }
 
-    connect_oper_t *oper = connect_oper_create(connect_done_cb, user_data,
+    connect_oper_t *oper = connect_oper_create(connect_done_cb, user_data, device_name,
                                                l_dbus_proxy_get_path(proxy),
-                                               ssid, passphrase, do_hidden);
-    s_connect_oper = oper;
+                                               ssid, passphrase, do_hidden, start_usec);
+    l_hashmap_insert(s_connect_opers, device_name, oper);
     l_debug("iwd_client: Connect do_hidden=%u oper=%p path=%s interface=%s",
             do_hidden, oper, l_dbus_proxy_get_path(proxy), l_dbus_proxy_get_interface(proxy));
+    oper->trace_seq = iwd_trace_call(proxy, do_hidden ? "ConnectHiddenNetwork" : "Connect");
     uint32_t callid = l_dbus_proxy_method_call(proxy,
                                                do_hidden ? "ConnectHiddenNetwork" : "Connect",
                                                connect_setup_handler,
@@ -256,10 +416,100 @@ bool iwd_client_connect(const char *device_name,
                                                oper, // user_data
                                                connect_destroy_handler);
     if (callid == 0) {
+        l_hashmap_remove(s_connect_opers, device_name);
         connect_oper_error_and_destroy(oper, IWD_STATUS_DBUS_SEND_FAILED);
-        s_connect_oper = NULL;
         return false;
     }
 
     return true;
 }
+
+static void connect_scan_destroy(connect_scan_t *scan)
+{
+    l_free(scan->device_name);
+    l_free(scan->ssid);
+    l_free(scan->passphrase);
+    l_free(scan);
+}
+
+// A connect waiting for its scan is overridden by a new connect on the same device, same as a connect in progress
+static void connect_scan_override(const char *device_name)
+{
+    connect_scan_t *scan = l_hashmap_remove(s_connect_scans, device_name);
+    if (scan == NULL) {
+        return;
+    }
+
+    l_warn("iwd_client: Another Connect is already waiting for a scan on %s. Overriding", device_name);
+    iwd_stats_record(IWD_OPER_CONNECT, IWD_STATUS_CONNECT_OVERRIDEN, scan->start_usec);
+    scan->done_cb(IWD_STATUS_CONNECT_OVERRIDEN, scan->user_data);
+    scan->done_cb = NULL; // Freed when the scan is done
+}
+
+static void connect_scan_done(iwd_status_t status, struct l_queue *networks, void *user_data)
+{
+    connect_scan_t *scan = user_data;
+
+    iwd_network_list_destroy(networks); // The Network proxies are what is looked up
+
+    if (scan->done_cb) {
+        l_hashmap_remove(s_connect_scans, scan->device_name);
+
+        if (status == IWD_STATUS_DBUS_ABORTED) {
+            iwd_stats_record(IWD_OPER_CONNECT, status, scan->start_usec);
+            scan->done_cb(status, scan->user_data);
+        }
+        else {
+            // Also on a failed or timed out scan. The Network might have shown up anyway, or it is hidden.
+            l_info("iwd_client: Scan before connect on %s done with status=%d. Retrying ssid='%s'",
+                   scan->device_name, status, scan->ssid);
+            connect_start(scan->device_name, scan->ssid, scan->passphrase, IWD_CONNECT_AUTO_SCAN_HIDDEN,
+                          scan->done_cb, scan->user_data, scan->start_usec);
+        }
+    }
+
+    connect_scan_destroy(scan);
+}
+
+bool iwd_client_connect(const char *device_name,
+                        const char *ssid,
+                        const char *passphrase, // Allowed to be NULL for open wifi
+                        iwd_connect_hidden_t hidden,
+                        iwd_client_connect_done_cb_t connect_done_cb,
+                        void *user_data)
+{
+    assert(connect_done_cb);
+    assert(ssid);
+
+    l_info("iwd_client: Connecting to ssid='%s' on %s", ssid, device_name);
+
+    connect_scan_override(device_name);
+
+    uint64_t start_usec = l_time_now();
+
+    if (hidden == IWD_CONNECT_AUTO_SCAN_HIDDEN && !iwd_proxies_get_network_for_ssid(device_name, ssid)) {
+        l_info("iwd_client: Network for ssid='%s' is not found on '%s'. Scanning for it first",
+               ssid, device_name);
+
+        connect_scan_t *scan = l_new(connect_scan_t, 1);
+        scan->done_cb = connect_done_cb;
+        scan->user_data = user_data;
+        scan->device_name = l_strdup(device_name);
+        scan->ssid = l_strdup(ssid);
+        scan->passphrase = l_strdup(passphrase);
+        scan->start_usec = start_usec;
+        l_hashmap_insert(s_connect_scans, device_name, scan);
+
+        // Callback is always called, also on early errors
+        return iwd_client_scan_ordered_networks_async(device_name, s_connect_scan_budget_ms,
+                                                      connect_scan_done, scan);
+    }
+
+    return connect_start(device_name, ssid, passphrase, hidden, connect_done_cb, user_data, start_usec);
+}
+
+void iwd_client_set_connect_scan_budget_ms(uint32_t budget_ms)
+{
+    assert(budget_ms > 0);
+    s_connect_scan_budget_ms = budget_ms;
+}
@@ -0,0 +1,350 @@
+//****************************************************************************
+//    Copyright (C) 2022 Orbital Systems AB.
+//    All rights reserved
+//****************************************************************************
+#include "iwd_client.h"
+
+#include "iwd_client_internal.h"
+#include "iwd_proxies.h"
+#include "iwd_trace.h"
+#include "iwd_util.h"
+
+#include <assert.h>
+#include <string.h>
+
+// Samples StationDiagnostic.GetDiagnostics of every connected station at a fixed interval.
+// Each reply is decoded once into an iwd_diagnostic_sample_t in a ring of the device, allocated when the device
+// is first sampled. Readers copy out of the rings, nothing is allocated for them.
+
+typedef struct {
+    iwd_diagnostic_sample_t *samples; // s_capacity
+    size_t next; // Where the next sample goes
+    size_t count;
+    bool calling; // GetDiagnostics in flight
+    uint32_t generation; // Unique to the ring, so calls of a ring that is gone don't touch a new one
+} diagnostics_ring_t;
+
+static struct l_hashmap *s_rings; // device_name -> diagnostics_ring_t
+static struct l_timeout *s_timeout; // NULL when not sampling
+static uint32_t s_interval_ms;
+static size_t s_capacity; // Samples in each ring
+static uint32_t s_generation; // Bumped for each new ring
+
+// user_data of a GetDiagnostics call
+typedef struct {
+    char *device_name;
+    uint32_t generation; // Of the ring when called
+    uint32_t trace_seq; // Of the GetDiagnostics call
+} diagnostics_call_t;
+
+static void diagnostics_ring_destroy(void *data)
+{
+    diagnostics_ring_t *ring = data;
+
+    l_free(ring->samples);
+    l_free(ring);
+}
+
+// Index of the i:th newest sample
+static size_t diagnostics_ring_index(const diagnostics_ring_t *ring, size_t i)
+{
+    return (ring->next + s_capacity - 1 - i) % s_capacity;
+}
+
+static iwd_security_t diagnostics_security_decode(const char *name)
+{
+    // "Open", "WEP", "WPA2-Personal", "WPA3-Personal", "WPA2-Enterprise", "WPA3-Enterprise", ...
+    if (strstr(name, "Enterprise")) {
+        return IWD_SECURITY_8021X;
+    }
+    if (strstr(name, "Personal") || strstr(name, "PSK")) {
+        return IWD_SECURITY_PSK;
+    }
+    if (strstr(name, "WEP")) {
+        return IWD_SECURITY_WEP;
+    }
+    if (strstr(name, "Open") || strstr(name, "OWE")) {
+        return IWD_SECURITY_OPEN;
+    }
+    return IWD_SECURITY_UNKNOWN;
+}
+
+static bool diagnostics_decode(struct l_dbus_message *msg, iwd_diagnostic_sample_t *sample)
+{
+    struct l_dbus_message_iter dict;
+    if (!l_dbus_message_get_arguments(msg, "a{sv}", &dict)) {
+        return false;
+    }
+
+    const char *key;
+    struct l_dbus_message_iter variant;
+    while (l_dbus_message_iter_next_entry(&dict, &key, &variant)) {
+        const char *str;
+        uint32_t u32;
+        uint16_t u16;
+        int16_t i16;
+
+        if (streq(key, "ConnectedBss") && l_dbus_message_iter_get_variant(&variant, "s", &str)) {
+            l_strlcpy(sample->bss, str, sizeof(sample->bss));
+        }
+        else if (streq(key, "Security") && l_dbus_message_iter_get_variant(&variant, "s", &str)) {
+            l_strlcpy(sample->security_name, str, sizeof(sample->security_name));
+            sample->security = diagnostics_security_decode(str);
+        }
+        else if (streq(key, "Frequency") && l_dbus_message_iter_get_variant(&variant, "u", &u32)) {
+            sample->frequency_mhz = u32;
+        }
+        else if (streq(key, "Channel") && l_dbus_message_iter_get_variant(&variant, "q", &u16)) {
+            sample->channel = u16;
+        }
+        else if (streq(key, "RSSI") && l_dbus_message_iter_get_variant(&variant, "n", &i16)) {
+            sample->rssi100 = i16 * 100;
+        }
+        else if (streq(key, "AverageRSSI") && l_dbus_message_iter_get_variant(&variant, "n", &i16)) {
+            sample->average_rssi100 = i16 * 100;
+        }
+        else if (streq(key, "RxBitrate") && l_dbus_message_iter_get_variant(&variant, "u", &u32)) {
+            sample->rx_bitrate_kbps = u32 * 100; // Given in 100 kbit/s
+        }
+        else if (streq(key, "TxBitrate") && l_dbus_message_iter_get_variant(&variant, "u", &u32)) {
+            sample->tx_bitrate_kbps = u32 * 100; // Given in 100 kbit/s
+        }
+        else if (streq(key, "InactiveTime") && l_dbus_message_iter_get_variant(&variant, "u", &u32)) {
+            sample->inactive_ms = u32;
+        }
+    }
+
+    return true;
+}
+
+static void diagnostics_reply_handler(struct l_dbus_proxy *proxy,
+                                      struct l_dbus_message *msg,
+                                      void *user_data)
+{
+    const diagnostics_call_t *call = user_data;
+    iwd_trace_reply(proxy, "GetDiagnostics", msg, call->trace_seq);
+
+    const char *device_name = call->device_name;
+
+    diagnostics_ring_t *ring = l_hashmap_lookup(s_rings, device_name);
+    if (ring == NULL || ring->generation != call->generation) {
+        return; // Restarted, or device gone, meanwhile
+    }
+
+    if (l_dbus_message_is_error(msg)) {
+        const char *name = "";
+        const char *text = "";
+        (void)l_dbus_message_get_error(msg, &name, &text);
+        l_debug("iwd_client: GetDiagnostics on %s failed. name='%s' text='%s'", device_name, name, text);
+        return;
+    }
+
+    // Into the ring only when complete, so a broken reply doesn't overwrite the oldest sample
+    iwd_diagnostic_sample_t sample = { .time_usec = l_time_now() };
+    if (!diagnostics_decode(msg, &sample)) {
+        l_error("iwd_client: GetDiagnostics on %s failed to parse message", device_name);
+        return;
+    }
+
+    ring->samples[ring->next] = sample;
+    ring->next = (ring->next + 1) % s_capacity;
+    if (ring->count < s_capacity) {
+        ring->count++;
+    }
+}
+
+static void diagnostics_destroy_handler(void *user_data)
+{
+    diagnostics_call_t *call = user_data;
+
+    // A later ring of the device has calls of its own
+    diagnostics_ring_t *ring = s_rings ? l_hashmap_lookup(s_rings, call->device_name) : NULL;
+    if (ring && ring->generation == call->generation) {
+        ring->calling = false;
+    }
+    l_free(call->device_name);
+    l_free(call);
+}
+
+static void diagnostics_each_station(struct l_dbus_proxy *proxy, const iwd_proxy_props_t *props,
+                                     __attribute__((unused)) void *user_data)
+{
+    if (props->connected_path == NULL) {
+        return; // Only connected stations have diagnostics
+    }
+
+    const char *device_name = iwd_proxies_get_device_name_for_station(proxy);
+    struct l_dbus_proxy *proxy_diagnostic = device_name ?
+                                            iwd_proxies_get_station_diagnostic_for_device(device_name) : NULL;
+    if (proxy_diagnostic == NULL) {
+        return;
+    }
+
+    diagnostics_ring_t *ring = l_hashmap_lookup(s_rings, device_name);
+    if (ring == NULL) {
+        ring = l_new(diagnostics_ring_t, 1);
+        ring->samples = l_new(iwd_diagnostic_sample_t, s_capacity);
+        ring->generation = ++s_generation;
+        l_hashmap_insert(s_rings, device_name, ring);
+    }
+
+    if (ring->calling) {
+        return; // Slower than the interval. Skip this sample.
+    }
+
+    diagnostics_call_t *call = l_new(diagnostics_call_t, 1);
+    call->device_name = l_strdup(device_name);
+    call->generation = ring->generation;
+
+    call->trace_seq = iwd_trace_call(proxy_diagnostic, "GetDiagnostics");
+    uint32_t callid = l_dbus_proxy_method_call(proxy_diagnostic, "GetDiagnostics",
+                                               NULL, // No arguments needs setup into message
+                                               diagnostics_reply_handler,
+                                               call, // user_data
+                                               diagnostics_destroy_handler);
+    if (callid == 0) {
+        l_free(call->device_name);
+        l_free(call);
+        return;
+    }
+    ring->calling = true;
+}
+
+static void diagnostics_timeout(struct l_timeout *timeout, __attribute__((unused)) void *user_data)
+{
+    iwd_proxies_foreach_station(diagnostics_each_station, NULL);
+    l_timeout_modify_ms(timeout, s_interval_ms);
+}
+
+void iwd_client_diagnostics_init(void)
+{
+    s_rings = l_hashmap_string_new();
+}
+
+void iwd_client_diagnostics_deinit(void)
+{
+    l_timeout_remove(s_timeout);
+    s_timeout = NULL;
+    l_hashmap_destroy(s_rings, diagnostics_ring_destroy);
+    s_rings = NULL;
+}
+
+void iwd_client_diagnostics_device_gone(const char *device_name)
+{
+    // Samples are of the station that is gone. A call in flight finds no ring, or a new one that is not its.
+    diagnostics_ring_t *ring = s_rings ? l_hashmap_remove(s_rings, device_name) : NULL;
+    if (ring) {
+        diagnostics_ring_destroy(ring);
+    }
+}
+
+void iwd_client_diagnostics_start(uint32_t interval_ms, size_t capacity)
+{
+    assert(interval_ms > 0);
+    assert(capacity > 0);
+
+    l_info("iwd_client: Sampling station diagnostics every %u ms, keeping %zu samples", interval_ms, capacity);
+
+    // Start over, as the rings are of the old capacity
+    iwd_client_diagnostics_deinit();
+    iwd_client_diagnostics_init();
+
+    s_interval_ms = interval_ms;
+    s_capacity = capacity;
+    s_timeout = l_timeout_create_ms(interval_ms, diagnostics_timeout, NULL, NULL);
+}
+
+void iwd_client_diagnostics_stop(void)
+{
+    l_info("iwd_client: Stopped sampling station diagnostics");
+
+    l_timeout_remove(s_timeout);
+    s_timeout = NULL;
+}
+
+size_t iwd_client_diagnostics_window(const char *device_name, uint64_t since_usec,
+                                     iwd_diagnostic_sample_t *samples, size_t max)
+{
+    const diagnostics_ring_t *ring = s_rings ? l_hashmap_lookup(s_rings, device_name) : NULL;
+    if (ring == NULL) {
+        return 0;
+    }
+
+    size_t copied = 0;
+    for (size_t i = 0; i < ring->count && copied < max; i++) {
+        const iwd_diagnostic_sample_t *sample = &ring->samples[diagnostics_ring_index(ring, i)];
+        if (sample->time_usec < since_usec) {
+            break;
+        }
+        samples[copied++] = *sample;
+    }
+    return copied;
+}
+
+typedef struct {
+    int64_t sum;
+    uint32_t count;
+} diagnostics_sum_t;
+
+static void diagnostics_range_add(iwd_diagnostic_range_t *range, diagnostics_sum_t *sum, int32_t value)
+{
+    if (sum->count == 0 || value < range->min) {
+        range->min = value;
+    }
+    if (sum->count == 0 || value > range->max) {
+        range->max = value;
+    }
+    sum->sum += value;
+    sum->count++;
+}
+
+static void diagnostics_range_finish(iwd_diagnostic_range_t *range, const diagnostics_sum_t *sum)
+{
+    range->avg = sum->count ? (int32_t)(sum->sum / sum->count) : 0;
+}
+
+bool iwd_client_diagnostics_summary(const char *device_name, uint64_t since_usec,
+                                    iwd_diagnostic_summary_t *summary)
+{
+    assert(summary);
+
+    memset(summary, 0, sizeof(*summary));
+
+    const diagnostics_ring_t *ring = s_rings ? l_hashmap_lookup(s_rings, device_name) : NULL;
+    if (ring == NULL) {
+        return false;
+    }
+
+    diagnostics_sum_t rssi = { 0 };
+    diagnostics_sum_t rx = { 0 };
+    diagnostics_sum_t tx = { 0 };
+    diagnostics_sum_t frequency = { 0 };
+
+    for (size_t i = 0; i < ring->count; i++) {
+        const iwd_diagnostic_sample_t *sample = &ring->samples[diagnostics_ring_index(ring, i)];
+        if (sample->time_usec < since_usec) {
+            break;
+        }
+
+        if (summary->count == 0) {
+            summary->last_usec = sample->time_usec; // Newest first
+        }
+        summary->first_usec = sample->time_usec;
+        summary->count++;
+
+        diagnostics_range_add(&summary->rssi100, &rssi, sample->rssi100);
+        diagnostics_range_add(&summary->frequency_mhz, &frequency, (int32_t)sample->frequency_mhz);
+        if (sample->rx_bitrate_kbps) {
+            diagnostics_range_add(&summary->rx_bitrate_kbps, &rx, (int32_t)sample->rx_bitrate_kbps);
+        }
+        if (sample->tx_bitrate_kbps) {
+            diagnostics_range_add(&summary->tx_bitrate_kbps, &tx, (int32_t)sample->tx_bitrate_kbps);
+        }
+    }
+
+    diagnostics_range_finish(&summary->rssi100, &rssi);
+    diagnostics_range_finish(&summary->rx_bitrate_kbps, &rx);
+    diagnostics_range_finish(&summary->tx_bitrate_kbps, &tx);
+    diagnostics_range_finish(&summary->frequency_mhz, &frequency);
+    return true;
+}
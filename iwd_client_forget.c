@@ -4,13 +4,17 @@
 //****************************************************************************
 #include "iwd_client.h"
 
+#include "iwd_client_internal.h"
 #include "iwd_proxies.h"
+#include "iwd_trace.h"
 
 #include <assert.h>
 
 typedef struct {
     iwd_client_forget_done_cb_t done_cb;
     void *user_data;
+    uint64_t start_usec; // l_time_now() at the call
+    uint32_t trace_seq; // Of the Forget call
 } forget_oper_t;
 
 static forget_oper_t *forget_oper_create(iwd_client_forget_done_cb_t done_cb,
@@ -19,6 +23,7 @@ static forget_oper_t *forget_oper_create(iwd_client_forget_done_cb_t done_cb,
     forget_oper_t *oper = l_new(forget_oper_t, 1);
     oper->done_cb = done_cb;
     oper->user_data = user_data;
+    oper->start_usec = l_time_now();
     return oper;
 }
 
@@ -26,6 +31,7 @@ static void forget_oper_run_callback(forget_oper_t *oper, iwd_status_t status)
 {
     assert(oper);
     assert(oper->done_cb);
+    iwd_stats_record(IWD_OPER_FORGET, status, oper->start_usec);
     oper->done_cb(status, oper->user_data);
     oper->done_cb = NULL; // Mark it called
 }
@@ -48,13 +54,15 @@ static void forget_oper_error_and_destroy(forget_oper_t *oper, iwd_status_t stat
     forget_oper_destroy(oper);
 }
 
-static void forget_reply_handler(__attribute__((unused)) struct l_dbus_proxy *unused_proxy,
+static void forget_reply_handler(struct l_dbus_proxy *proxy,
                                   struct l_dbus_message *msg,
                                   void *user_data)
 {
     forget_oper_t *oper = (forget_oper_t *)user_data;
     assert(oper);
 
+    iwd_trace_reply(proxy, "Forget", msg, oper->trace_seq);
+
     if (l_dbus_message_is_error(msg)) {
         const char *name = NULL;
         const char *text = NULL;
@@ -92,6 +100,7 @@ bool iwd_client_forget(const char *ssid, iwd_client_forget_done_cb_t forget_done
         return false;
     }
 
+    oper->trace_seq = iwd_trace_call(proxy_knownnetwork, "Forget");
     uint32_t callid = l_dbus_proxy_method_call(proxy_knownnetwork, "Forget",
                                                NULL, // No arguments needs setup into message
                                                forget_reply_handler,
@@ -0,0 +1,126 @@
+//****************************************************************************
+//    Copyright (C) 2022 Orbital Systems AB.
+//    All rights reserved
+//****************************************************************************
+#pragma once
+
+// Internal functions shared between the iwd_client*.c files. Not part of the API.
+
+#include "iwd_client.h"
+#include "iwd_network.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// iwd_client.c
+bool iwd_client_is_ready(void); // Connected to iwd and all proxies are added
+
+// iwd_client_connect.c
+void iwd_client_connect_init(void);
+void iwd_client_connect_deinit(void);
+void iwd_client_connect_station_state(const char *device_name, const char *state);
+void iwd_client_connect_connected_network(const char *device_name, const char *connected_path); // NULL = none
+// Given as callback to iwd_agent.c in iwd_client_init().
+const char *iwd_client_connect_agent_get_passphrase(const char *network_path);
+bool iwd_client_connect_in_progress(const char *device_name); // Connect, or its scan, in flight on the device
+
+// iwd_client_diagnostics.c
+void iwd_client_diagnostics_init(void);
+void iwd_client_diagnostics_deinit(void);
+void iwd_client_diagnostics_device_gone(const char *device_name);
+
+// iwd_client_ordered_networks.c
+void iwd_client_ordered_networks_cache_init(void);
+void iwd_client_ordered_networks_cache_deinit(void);
+void iwd_client_ordered_networks_cache_clear(void);
+void iwd_client_ordered_networks_cache_device_gone(const char *device_name);
+void iwd_client_ordered_networks_cache_refresh(const char *device_name); // Fetch GetOrderedNetworks into cache
+// Lowest request that a cache update must be from to be fetched after now, when a refresh in flight will give one.
+// 0 if no refresh is in flight.
+uint32_t iwd_client_ordered_networks_cache_refresh_wait(const char *device_name);
+// Stale networks, from the snapshot. Takes ownership of networks. Ignored if the device has live networks.
+void iwd_client_ordered_networks_cache_seed(const char *device_name, struct l_queue *networks);
+
+// Fills view from the proxy properties of the network at path. False if the network can't be used.
+bool iwd_client_ordered_networks_resolve(const char *path, int16_t rssi100, iwd_network_view_t *view);
+
+// One GetOrderedNetworks call, shared by the variants of iwd_client_ordered_networks*.c. They differ only in how the
+// networks of the reply are decoded and given to their callback, which is done by decode_cb. It is run once: with
+// the a(on) array of the reply on success, or with networks NULL and the status of the failure.
+typedef struct iwd_client_ordered_networks_oper iwd_client_ordered_networks_oper_t;
+typedef void (*iwd_client_ordered_networks_decode_cb_t)(iwd_client_ordered_networks_oper_t *oper,
+                                                         iwd_status_t status,
+                                                         struct l_dbus_message_iter *networks);
+struct iwd_client_ordered_networks_oper {
+    iwd_client_ordered_networks_decode_cb_t decode_cb; // NULL once run
+    union {
+        iwd_client_ordered_networks_done_cb_t list; // NULL for a cache refresh
+        iwd_client_ordered_networks_packed_done_cb_t packed;
+        iwd_client_ordered_networks_view_done_cb_t view;
+    } done_cb; // Of the variant, run by decode_cb
+    void *user_data;
+    char *device_name;
+    uint32_t request; // Order of the call, to not let an older reply replace a newer in the cache
+    uint64_t start_usec; // l_time_now() at the call
+    uint32_t trace_seq; // Of the GetOrderedNetworks call
+    bool refresh; // Cache refresh, without callback and not counted in the stats
+};
+// Set done_cb of the variant before the call
+iwd_client_ordered_networks_oper_t *iwd_client_ordered_networks_oper_create(
+    const char *device_name,
+    iwd_client_ordered_networks_decode_cb_t decode_cb,
+    void *user_data);
+// Takes ownership of oper. False if not sent, after decode_cb is run with the failure.
+bool iwd_client_ordered_networks_oper_call(iwd_client_ordered_networks_oper_t *oper);
+
+// iwd_client_ordered_networks_delta.c
+void iwd_client_ordered_networks_delta_init(void);
+void iwd_client_ordered_networks_delta_deinit(void);
+void iwd_client_ordered_networks_delta_update(const char *device_name, struct l_queue *networks); // New result
+
+// iwd_client_scan.c
+void iwd_client_scan_init(void);
+void iwd_client_scan_deinit(void);
+
+// iwd_client_scan_schedule.c
+void iwd_client_scan_schedule_init(void);
+void iwd_client_scan_schedule_deinit(void);
+void iwd_client_scan_schedule_clear(void); // Disconnected from iwd
+void iwd_client_scan_schedule_device_ready(const char *device_name);
+void iwd_client_scan_schedule_device_gone(const char *device_name);
+void iwd_client_scan_schedule_connected_network(const char *device_name, const char *connected_path); // NULL = none
+// Result of a finished scan, from the cache refresh that follows it
+void iwd_client_scan_schedule_networks_updated(const char *device_name, struct l_queue *networks);
+
+// iwd_client_signal_level.c
+void iwd_client_signal_level_init(void);
+void iwd_client_signal_level_deinit(void);
+void iwd_client_signal_level_clear(void); // Disconnected from iwd
+void iwd_client_signal_level_device_ready(const char *device_name);
+void iwd_client_signal_level_device_gone(const char *device_name);
+// Given as callbacks to iwd_agent.c in iwd_client_init().
+void iwd_client_signal_level_agent_changed(const char *device_path, uint8_t level);
+void iwd_client_signal_level_agent_released(const char *device_path);
+void iwd_client_signal_level_agent_register_failed(const char *device_name, uint32_t registration);
+
+// iwd_client_snapshot.c
+void iwd_client_snapshot_seed_cache(void); // Puts the ordered networks of the last snapshot in the cache
+void iwd_client_snapshot_changed(void); // Something saved in the snapshot has changed
+
+// iwd_client_station_events.c
+void iwd_client_station_events_init(void);
+void iwd_client_station_events_deinit(void);
+bool iwd_client_station_events_coalesced(void); // True if changes go to iwd_client_station_events_changed()
+void iwd_client_station_events_changed(const char *device_name, iwd_station_changed_t changed);
+
+// iwd_client_scan_networks.c
+void iwd_client_scan_networks_init(void);
+void iwd_client_scan_networks_deinit(void);
+void iwd_client_scan_networks_scan_finished(const char *device_name);
+// The cache on device_name was updated with networks from request
+void iwd_client_scan_networks_cache_updated(const char *device_name, uint32_t request, struct l_queue *networks);
+void iwd_client_scan_networks_refresh_done(const char *device_name); // No cache refresh is left in flight
+
+// iwd_stats.c
+// Called when the callback of an operation is run. start_usec is l_time_now() at the call.
+void iwd_stats_record(iwd_oper_t oper, iwd_status_t status, uint64_t start_usec);
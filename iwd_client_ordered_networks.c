@@ -4,152 +4,441 @@
 //****************************************************************************
 #include "iwd_client.h"
 
+#include "iwd_client_internal.h"
 #include "iwd_proxies.h"
+#include "iwd_trace.h"
 
 #include <assert.h>
 
+//
+// Cache
+// Last ordered networks per device. Refreshed when a scan finishes and on every GetOrderedNetworks.
+//
+
 typedef struct {
-    iwd_client_ordered_networks_done_cb_t done_cb;
-    void *user_data;
-} ordered_networks_oper_t;
+    struct l_queue *networks; // iwd_network_t. NULL until first fetched
+    uint32_t generation; // Bumped each time networks is replaced
+    uint32_t request; // Request of networks. Replies to earlier requests are too old to replace them.
+    bool stale; // networks is from the snapshot, not from iwd
+    bool refreshing; // A cache refresh is in flight
+    uint32_t refresh_request; // Request of the refresh in flight
+    bool refresh_again; // Another refresh was asked for while refreshing
+} ordered_networks_cache_t;
+
+static struct l_hashmap *s_cache; // device_name -> ordered_networks_cache_t
+static uint32_t s_cache_generation; // Generations are unique over all devices
+static uint32_t s_request; // Last GetOrderedNetworks request, over all devices
 
-static ordered_networks_oper_t *ordered_networks_oper_create(iwd_client_ordered_networks_done_cb_t done_cb,
-                                                             void *user_data)
+static void ordered_networks_cache_destroy(void *data)
 {
-    ordered_networks_oper_t *oper = l_new(ordered_networks_oper_t, 1);
-    oper->done_cb = done_cb;
-    oper->user_data = user_data;
-    return oper;
+    ordered_networks_cache_t *cache = data;
+
+    iwd_network_list_destroy(cache->networks);
+    l_free(cache);
 }
 
-static void ordered_networks_oper_run_callback(ordered_networks_oper_t *oper, iwd_status_t status,
-                                               struct l_queue *networks)
+static ordered_networks_cache_t *ordered_networks_cache_get(const char *device_name)
 {
-    assert(oper);
-    assert(oper->done_cb);
-    oper->done_cb(status, networks, oper->user_data);
-    oper->done_cb = NULL; // Mark it called
+    ordered_networks_cache_t *cache = l_hashmap_lookup(s_cache, device_name);
+    if (cache == NULL) {
+        cache = l_new(ordered_networks_cache_t, 1);
+        l_hashmap_insert(s_cache, device_name, cache);
+    }
+
+    return cache;
 }
 
-static void ordered_networks_oper_destroy(ordered_networks_oper_t *oper)
+// Takes ownership of networks. Dropped if they are from an earlier request than those in the cache, as replies
+// to a forced fetch and a background refresh can come in any order.
+static void ordered_networks_cache_update(const char *device_name, uint32_t request, struct l_queue *networks)
 {
-    assert(oper);
+    ordered_networks_cache_t *cache = ordered_networks_cache_get(device_name);
+    if (request < cache->request) {
+        l_debug("iwd_client: Ordered networks on %s from request=%u are older than cached request=%u. Dropped",
+                device_name, request, cache->request);
+        iwd_network_list_destroy(networks);
+        return;
+    }
 
-    // Callback has not been run yet. Operation was propably aborted
-    if (oper->done_cb) {
-        l_error("iwd_client: GetOrderedNetworks was DBUS-aborted?");
-        ordered_networks_oper_run_callback(oper, IWD_STATUS_DBUS_ABORTED, NULL);
+    iwd_client_ordered_networks_delta_update(device_name, networks);
+
+    iwd_network_list_destroy(cache->networks);
+    cache->networks = networks;
+    cache->generation = ++s_cache_generation;
+    cache->request = request;
+    cache->stale = false;
+
+    l_debug("iwd_client: Ordered networks cache on %s updated to generation=%u (%u networks)",
+            device_name, cache->generation, l_queue_length(networks));
+
+    iwd_client_snapshot_changed();
+    iwd_client_scan_networks_cache_updated(device_name, request, networks); // Last, it runs callbacks
+}
+
+void iwd_client_ordered_networks_cache_seed(const char *device_name, struct l_queue *networks)
+{
+    ordered_networks_cache_t *cache = ordered_networks_cache_get(device_name);
+    if (cache->networks) {
+        iwd_network_list_destroy(networks); // Live data is never replaced by stale
+        return;
     }
-    l_free(oper);
+
+    cache->networks = networks;
+    cache->generation = ++s_cache_generation;
+    cache->stale = true;
+
+    l_debug("iwd_client: Ordered networks cache on %s seeded with %u stale networks",
+            device_name, l_queue_length(networks));
 }
 
-static void ordered_networks_oper_error_and_destroy(ordered_networks_oper_t *oper, iwd_status_t status)
+void iwd_client_ordered_networks_cache_init(void)
 {
-    ordered_networks_oper_run_callback(oper, status, NULL);
-    ordered_networks_oper_destroy(oper);
+    s_cache = l_hashmap_string_new();
 }
 
-static void ordered_networks_reply_handler(__attribute__((unused)) struct l_dbus_proxy *unused_proxy,
-                                           struct l_dbus_message *msg,
-                                           void *user_data)
+void iwd_client_ordered_networks_cache_deinit(void)
 {
-    ordered_networks_oper_t *oper = (ordered_networks_oper_t *)user_data;
-    assert(oper);
+    l_hashmap_destroy(s_cache, ordered_networks_cache_destroy);
+    s_cache = NULL;
+}
 
-    if (l_dbus_message_is_error(msg)) {
-        l_error("iwd_client: GetOrderedNetworks failed");
-        ordered_networks_oper_run_callback(oper, IWD_STATUS_DBUS_REPLY_ERROR, NULL);
-        return;
+// True if the cache is to be removed
+static bool ordered_networks_cache_drop(ordered_networks_cache_t *cache)
+{
+    if (cache->refreshing) {
+        // Keep it for the refresh in flight, but the content is no longer valid, and neither is any reply
+        // to a request made before now
+        iwd_network_list_destroy(cache->networks);
+        cache->networks = NULL;
+        cache->generation = 0;
+        cache->request = s_request + 1;
+        cache->stale = false;
+        cache->refresh_again = false;
+        return false;
     }
 
-    struct l_dbus_message_iter array;
-    if (!l_dbus_message_get_arguments(msg, "a(on)", &array)) {
-        l_error("iwd_client: GetOrderedNetworks failed to parse message");
-        ordered_networks_oper_run_callback(oper, IWD_STATUS_DBUS_PARSE_FAILED, NULL);
-        return;
+    return true;
+}
+
+static bool ordered_networks_cache_remove_all(__attribute__((unused)) const void *key, void *value,
+                                              __attribute__((unused)) void *user_data)
+{
+    ordered_networks_cache_t *cache = value;
+
+    if (!ordered_networks_cache_drop(cache)) {
+        return false;
     }
 
-    // Our output of list of iwd_network_t
-    struct l_queue *list = l_queue_new();
+    ordered_networks_cache_destroy(cache);
+    return true;
+}
 
-    const char *path;
-    int16_t rssi100;
-    while (l_dbus_message_iter_next_entry(&array, &path, &rssi100)) {
-        struct l_dbus_proxy *proxy = iwd_proxies_get_network(path);
-        if (!proxy) {
-            l_error("iwd_client: Can't find proxy for network '%s'", path);
-            continue;
-        }
+void iwd_client_ordered_networks_cache_clear(void)
+{
+    l_hashmap_foreach_remove(s_cache, ordered_networks_cache_remove_all, NULL);
+}
 
-        const char *name = NULL;
-        if (!l_dbus_proxy_get_property(proxy, "Name", "s", &name)) {
-            l_warn("iwd_client: Can't get 'Name' property of network at path='%s'", path);
-            continue;
-        }
+void iwd_client_ordered_networks_cache_device_gone(const char *device_name)
+{
+    ordered_networks_cache_t *cache = l_hashmap_lookup(s_cache, device_name);
+    if (cache && ordered_networks_cache_drop(cache)) {
+        l_hashmap_remove(s_cache, device_name);
+        ordered_networks_cache_destroy(cache);
+    }
+}
 
-        const char *type = NULL;
-        if (!l_dbus_proxy_get_property(proxy, "Type", "s", &type)) {
-            l_warn("iwd_client: Can't get 'Type' property of network at path='%s'", path);
-            continue;
+struct l_queue *iwd_client_ordered_networks_cached(const char *device_name, uint32_t *generation)
+{
+    ordered_networks_cache_t *cache = s_cache ? l_hashmap_lookup(s_cache, device_name) : NULL;
+    if (cache == NULL || cache->networks == NULL) {
+        if (generation) {
+            *generation = 0;
         }
+        return NULL;
+    }
 
-        bool connected = false;
-        if (!l_dbus_proxy_get_property(proxy, "Connected", "b", &connected)) {
-            l_warn("iwd_client: Can't get 'Connected' property of network at path='%s'", path);
-            continue;
+    if (generation) {
+        *generation = cache->generation;
+    }
+    return cache->networks;
+}
+
+bool iwd_client_ordered_networks_cache_is_stale(const char *device_name)
+{
+    ordered_networks_cache_t *cache = s_cache ? l_hashmap_lookup(s_cache, device_name) : NULL;
+    return cache && cache->networks && cache->stale;
+}
+
+// A cache refresh after a scan has updated the cache. It is the result of the scan, unless another refresh is
+// to follow as this one might be from before the scan. The cache has the networks of this refresh, or of a later
+// fetch that replaced them.
+static void ordered_networks_cache_refreshed(const char *device_name)
+{
+    ordered_networks_cache_t *cache = l_hashmap_lookup(s_cache, device_name);
+    if (cache && !cache->refresh_again) {
+        iwd_client_scan_schedule_networks_updated(device_name, cache->networks);
+    }
+}
+
+//
+// GetOrderedNetworks
+//
+
+bool iwd_client_ordered_networks_resolve(const char *path, int16_t rssi100, iwd_network_view_t *view)
+{
+    const iwd_proxy_props_t *props = iwd_proxies_get_props_by_path(IWD_PROXY_NETWORK, path);
+    if (!props) {
+        l_error("iwd_client: Can't find proxy for network '%s'", path);
+        return false;
+    }
+
+    if (props->name == NULL) {
+        l_warn("iwd_client: Can't get 'Name' property of network at path='%s'", path);
+        return false;
+    }
+
+    const char *known_path = props->known_path;
+    const iwd_proxy_props_t *known_props = NULL;
+    bool hidden = false;
+    if (known_path) {
+        known_props = iwd_proxies_get_props_by_path(IWD_PROXY_KNOWN_NETWORK, known_path);
+
+        // Hidden is a property of the known network
+        if (known_props) {
+            hidden = known_props->hidden;
         }
+    }
+
+    IWD_HOT_DEBUG("iwd_client: "
+                  "Network connected=%u known=%u rssi=%d type=%s hidden=%u ssid=%-32s path=%s known_path=%s",
+                  props->connected, !!known_props, rssi100, iwd_security_to_string(props->security), hidden,
+                  props->name, path, known_path);
+
+    view->name = props->name;
+    view->security = props->security;
+    view->rssi100 = rssi100;
+    view->connected = props->connected;
+    view->hidden = hidden;
+    view->path = path;
+    view->known_path = known_path;
+    return true;
+}
 
-        const char *known_path = NULL;
-        struct l_dbus_proxy *known_proxy = NULL;
-        bool hidden = false;
-        if (l_dbus_proxy_get_property(proxy, "KnownNetwork", "o", &known_path)) {
-            known_proxy = iwd_proxies_get_knownnetwork(known_path);
+static void ordered_networks_oper_decode(iwd_client_ordered_networks_oper_t *oper, iwd_status_t status,
+                                         struct l_dbus_message_iter *networks)
+{
+    assert(oper);
+    assert(oper->decode_cb);
 
-            // This property only exists if it is Hidden.
-            (void)l_dbus_proxy_get_property(proxy, "Hidden", "b", &connected);
+    iwd_client_ordered_networks_decode_cb_t decode_cb = oper->decode_cb;
+    oper->decode_cb = NULL; // Mark it run
+
+    if (!oper->refresh) {
+        iwd_stats_record(IWD_OPER_ORDERED_NETWORKS, status, oper->start_usec);
+    }
+    decode_cb(oper, status, networks);
+}
+
+static void ordered_networks_oper_destroy(iwd_client_ordered_networks_oper_t *oper)
+{
+    assert(oper);
+
+    // Decode has not been run yet. Operation was propably aborted
+    if (oper->decode_cb) {
+        if (!oper->refresh) {
+            l_error("iwd_client: GetOrderedNetworks was DBUS-aborted?");
         }
+        ordered_networks_oper_decode(oper, IWD_STATUS_DBUS_ABORTED, NULL);
+    }
+    l_free(oper->device_name);
+    l_free(oper);
+}
+
+static void ordered_networks_reply_handler(struct l_dbus_proxy *proxy,
+                                           struct l_dbus_message *msg,
+                                           void *user_data)
+{
+    iwd_client_ordered_networks_oper_t *oper = (iwd_client_ordered_networks_oper_t *)user_data;
+    assert(oper);
 
-        l_debug("iwd_client: "
-                "Network connected=%u known=%u rssi=%d type=%s hidden=%u ssid=%-32s path=%s known_path=%s",
-                connected, !!known_proxy, rssi100, type, hidden, name, path, known_path);
+    iwd_trace_reply(proxy, "GetOrderedNetworks", msg, oper->trace_seq);
 
-        iwd_network_t *network = iwd_network_create(name, type, rssi100, connected, hidden, path, known_path);
-        l_queue_push_tail(list, network);
+    if (l_dbus_message_is_error(msg)) {
+        l_error("iwd_client: GetOrderedNetworks on %s failed", oper->device_name);
+        ordered_networks_oper_decode(oper, IWD_STATUS_DBUS_REPLY_ERROR, NULL);
+        return;
     }
 
-    ordered_networks_oper_run_callback(oper, IWD_STATUS_SUCCESS, list);
+    struct l_dbus_message_iter array;
+    if (!l_dbus_message_get_arguments(msg, "a(on)", &array)) {
+        l_error("iwd_client: GetOrderedNetworks on %s failed to parse message", oper->device_name);
+        ordered_networks_oper_decode(oper, IWD_STATUS_DBUS_PARSE_FAILED, NULL);
+        return;
+    }
+
+    ordered_networks_oper_decode(oper, IWD_STATUS_SUCCESS, &array);
 }
 
 static void ordered_networks_destroy_handler(void *user_data)
 {
-    ordered_networks_oper_t *oper = (ordered_networks_oper_t *)user_data;
+    iwd_client_ordered_networks_oper_t *oper = (iwd_client_ordered_networks_oper_t *)user_data;
     ordered_networks_oper_destroy(oper);
 }
 
-bool iwd_client_ordered_networks_async(const char *device_name,
-                                       iwd_client_ordered_networks_done_cb_t ordered_network_done_cb,
-                                       void *user_data)
+iwd_client_ordered_networks_oper_t *iwd_client_ordered_networks_oper_create(
+    const char *device_name,
+    iwd_client_ordered_networks_decode_cb_t decode_cb,
+    void *user_data)
 {
-    l_debug("iwd_client: Calling GetOrderedNetworks on %s", device_name);
+    assert(decode_cb);
 
-    ordered_networks_oper_t *oper = ordered_networks_oper_create(ordered_network_done_cb, user_data);
+    iwd_client_ordered_networks_oper_t *oper = l_new(iwd_client_ordered_networks_oper_t, 1);
+    oper->decode_cb = decode_cb;
+    oper->user_data = user_data;
+    oper->device_name = l_strdup(device_name);
+    oper->request = ++s_request;
+    oper->start_usec = l_time_now();
+    return oper;
+}
 
-    struct l_dbus_proxy *proxy_station = iwd_proxies_get_station_for_device(device_name);
+static bool ordered_networks_oper_call(iwd_client_ordered_networks_oper_t *oper,
+                                       l_dbus_destroy_func_t destroy_handler)
+{
+    struct l_dbus_proxy *proxy_station = iwd_proxies_get_station_for_device(oper->device_name);
     if (!proxy_station) {
-        l_error("iwd_client: Station for device='%s' is not found", device_name);
-        ordered_networks_oper_error_and_destroy(oper, IWD_STATUS_STATION_NOT_FOUND);
+        l_error("iwd_client: Station for device='%s' is not found", oper->device_name);
+        ordered_networks_oper_decode(oper, IWD_STATUS_STATION_NOT_FOUND, NULL);
+        ordered_networks_oper_destroy(oper);
         return false;
     }
 
+    oper->trace_seq = iwd_trace_call(proxy_station, "GetOrderedNetworks");
     uint32_t callid = l_dbus_proxy_method_call(proxy_station, "GetOrderedNetworks",
                                                NULL, // No arguments needs setup into message
                                                ordered_networks_reply_handler,
                                                oper, // user_data
-                                               ordered_networks_destroy_handler);
+                                               destroy_handler);
     if (callid == 0) {
-        ordered_networks_oper_error_and_destroy(oper, IWD_STATUS_DBUS_SEND_FAILED);
+        l_error("iwd_client: Failed to call GetOrderedNetworks on %s", oper->device_name);
+        ordered_networks_oper_decode(oper, IWD_STATUS_DBUS_SEND_FAILED, NULL);
+        ordered_networks_oper_destroy(oper);
         return false;
     }
 
     return true;
 }
+
+bool iwd_client_ordered_networks_oper_call(iwd_client_ordered_networks_oper_t *oper)
+{
+    assert(oper);
+    return ordered_networks_oper_call(oper, ordered_networks_destroy_handler);
+}
+
+// Decode into a list of iwd_network_t, for the callback and the cache
+static void ordered_networks_list_decode(iwd_client_ordered_networks_oper_t *oper, iwd_status_t status,
+                                         struct l_dbus_message_iter *networks)
+{
+    if (status != IWD_STATUS_SUCCESS) {
+        if (oper->done_cb.list) {
+            oper->done_cb.list(status, NULL, oper->user_data);
+        }
+        return;
+    }
+
+    // Our output of list of iwd_network_t
+    struct l_queue *list = l_queue_new();
+
+    const char *path;
+    int16_t rssi100;
+    while (l_dbus_message_iter_next_entry(networks, &path, &rssi100)) {
+        iwd_network_view_t view;
+        if (!iwd_client_ordered_networks_resolve(path, rssi100, &view)) {
+            continue;
+        }
+
+        l_queue_push_tail(list, iwd_network_from_view(&view));
+    }
+
+    if (oper->done_cb.list) {
+        ordered_networks_cache_update(oper->device_name, oper->request, iwd_network_list_copy(list));
+        oper->done_cb.list(IWD_STATUS_SUCCESS, list, oper->user_data);
+    }
+    else {
+        ordered_networks_cache_update(oper->device_name, oper->request, list);
+        ordered_networks_cache_refreshed(oper->device_name);
+    }
+}
+
+bool iwd_client_ordered_networks_async(const char *device_name,
+                                       iwd_client_ordered_networks_done_cb_t ordered_network_done_cb,
+                                       void *user_data)
+{
+    l_debug("iwd_client: Calling GetOrderedNetworks on %s", device_name);
+
+    iwd_client_ordered_networks_oper_t *oper =
+        iwd_client_ordered_networks_oper_create(device_name, ordered_networks_list_decode, user_data);
+    oper->done_cb.list = ordered_network_done_cb;
+    return iwd_client_ordered_networks_oper_call(oper);
+}
+
+//
+// Cache refresh
+// Same as above, but without a callback
+//
+
+static void ordered_networks_refresh_destroy_handler(void *user_data)
+{
+    iwd_client_ordered_networks_oper_t *oper = (iwd_client_ordered_networks_oper_t *)user_data;
+
+    ordered_networks_cache_t *cache = s_cache ? l_hashmap_lookup(s_cache, oper->device_name) : NULL;
+    if (cache) {
+        cache->refreshing = false;
+        if (cache->refresh_again) {
+            cache->refresh_again = false;
+            iwd_client_ordered_networks_cache_refresh(oper->device_name);
+        }
+    }
+
+    if (s_cache && !iwd_client_ordered_networks_cache_refresh_wait(oper->device_name)) {
+        // No refresh left to give a result. Those waiting for one fetch it themselves.
+        iwd_client_scan_networks_refresh_done(oper->device_name);
+    }
+
+    ordered_networks_oper_destroy(oper);
+}
+
+void iwd_client_ordered_networks_cache_refresh(const char *device_name)
+{
+    ordered_networks_cache_t *cache = l_hashmap_lookup(s_cache, device_name);
+    if (cache && cache->refreshing) {
+        // Result in flight might be from before the scan. Fetch again when it is done.
+        cache->refresh_again = true;
+        return;
+    }
+
+    l_debug("iwd_client: Refreshing ordered networks cache on %s", device_name);
+
+    iwd_client_ordered_networks_oper_t *oper =
+        iwd_client_ordered_networks_oper_create(device_name, ordered_networks_list_decode, NULL);
+    oper->refresh = true;
+    uint32_t request = oper->request;
+    if (!ordered_networks_oper_call(oper, ordered_networks_refresh_destroy_handler)) {
+        return;
+    }
+
+    // Only now, so there is no entry for a device without a station
+    cache = ordered_networks_cache_get(device_name);
+    cache->refreshing = true;
+    cache->refresh_request = request;
+}
+
+uint32_t iwd_client_ordered_networks_cache_refresh_wait(const char *device_name)
+{
+    ordered_networks_cache_t *cache = l_hashmap_lookup(s_cache, device_name);
+    if (cache == NULL || !cache->refreshing) {
+        return 0;
+    }
+
+    // The refresh in flight was called before now when it is to be done again. Then any later request will do.
+    return cache->refresh_again ? s_request + 1 : cache->refresh_request;
+}
@@ -0,0 +1,189 @@
+//****************************************************************************
+//    Copyright (C) 2022 Orbital Systems AB.
+//    All rights reserved
+//****************************************************************************
+#include "iwd_client.h"
+
+#include "iwd_client_internal.h"
+
+#include <stdlib.h>
+
+// Diffs each new ordered networks result of a device against what was last reported for it.
+// Comparing with the last reported RSSI, and not the previous result, makes a slow drift show up once it has
+// moved beyond the threshold in total. What was reported is kept over a reconnect to iwd, so networks that
+// are the same after the reconnect are not reported again.
+
+typedef struct {
+    char *name;
+    int16_t rssi100; // Last reported
+    bool connected; // Last reported
+    bool seen; // In the result being diffed
+} delta_entry_t;
+
+static struct l_hashmap *s_reported; // device_name -> l_hashmap of network path -> delta_entry_t
+
+static iwd_client_ordered_networks_delta_cb_t s_delta_cb;
+static uint16_t s_rssi_threshold100;
+
+static void delta_entry_destroy(void *data)
+{
+    delta_entry_t *entry = data;
+
+    l_free(entry->name);
+    l_free(entry);
+}
+
+static void delta_device_destroy(void *data)
+{
+    l_hashmap_destroy(data, delta_entry_destroy);
+}
+
+static void delta_entry_reset_seen(__attribute__((unused)) const void *key, void *value,
+                                   __attribute__((unused)) void *user_data)
+{
+    delta_entry_t *entry = value;
+
+    entry->seen = false;
+}
+
+typedef struct {
+    iwd_network_delta_t *deltas;
+    size_t count;
+    struct l_queue *removed; // delta_entry_t, freed after the callback
+    struct l_queue *removed_paths; // Copies of the keys, as the hashmap frees its key on remove
+} delta_removed_ctx_t;
+
+static bool delta_entry_remove_unseen(const void *key, void *value, void *user_data)
+{
+    delta_entry_t *entry = value;
+    delta_removed_ctx_t *ctx = user_data;
+
+    if (entry->seen) {
+        return false;
+    }
+
+    char *path = l_strdup(key);
+    l_queue_push_tail(ctx->removed_paths, path);
+
+    ctx->deltas[ctx->count++] = (iwd_network_delta_t) {
+        .kind = IWD_NETWORK_DELTA_REMOVED,
+        .name = entry->name,
+        .path = path,
+        .rssi100 = entry->rssi100,
+        .old_rssi100 = entry->rssi100,
+        .connected = entry->connected,
+    };
+    l_queue_push_tail(ctx->removed, entry);
+    return true;
+}
+
+void iwd_client_ordered_networks_delta_update(const char *device_name, struct l_queue *networks)
+{
+    if (s_delta_cb == NULL) {
+        return;
+    }
+
+    struct l_hashmap *reported = l_hashmap_lookup(s_reported, device_name);
+    if (reported == NULL) {
+        reported = l_hashmap_string_new();
+        l_hashmap_insert(s_reported, device_name, reported);
+    }
+
+    // Worst case, every new network is added and every reported one is removed
+    size_t max_count = l_queue_length(networks) + l_hashmap_size(reported);
+    iwd_network_delta_t *deltas = l_new(iwd_network_delta_t, max_count ? max_count : 1);
+    size_t count = 0;
+
+    l_hashmap_foreach(reported, delta_entry_reset_seen, NULL);
+
+    for (const struct l_queue_entry *qentry = l_queue_get_entries(networks); qentry; qentry = qentry->next) {
+        const iwd_network_t *network = qentry->data;
+
+        delta_entry_t *entry = l_hashmap_lookup(reported, network->path);
+        if (entry == NULL) {
+            entry = l_new(delta_entry_t, 1);
+            entry->name = l_strdup(network->name);
+            entry->rssi100 = network->rssi100;
+            entry->connected = network->connected;
+            entry->seen = true;
+            l_hashmap_insert(reported, network->path, entry);
+
+            deltas[count++] = (iwd_network_delta_t) {
+                .kind = IWD_NETWORK_DELTA_ADDED,
+                .name = network->name,
+                .path = network->path,
+                .rssi100 = network->rssi100,
+                .old_rssi100 = network->rssi100,
+                .connected = network->connected,
+            };
+            continue;
+        }
+
+        if (entry->seen) {
+            continue; // Same path twice in one result. Should not happen.
+        }
+        entry->seen = true;
+
+        bool rssi_moved = network->rssi100 != entry->rssi100 &&
+                          abs(network->rssi100 - entry->rssi100) >= s_rssi_threshold100;
+        if (rssi_moved || network->connected != entry->connected) {
+            deltas[count++] = (iwd_network_delta_t) {
+                .kind = IWD_NETWORK_DELTA_CHANGED,
+                .name = network->name,
+                .path = network->path,
+                .rssi100 = network->rssi100,
+                .old_rssi100 = entry->rssi100,
+                .connected = network->connected,
+            };
+            entry->rssi100 = network->rssi100;
+            entry->connected = network->connected;
+        }
+    }
+
+    delta_removed_ctx_t ctx = {
+        .deltas = deltas,
+        .count = count,
+        .removed = l_queue_new(),
+        .removed_paths = l_queue_new(),
+    };
+    l_hashmap_foreach_remove(reported, delta_entry_remove_unseen, &ctx);
+    count = ctx.count;
+
+    if (count > 0) {
+        l_debug("iwd_client: Ordered networks on %s changed. %zu deltas", device_name, count);
+        s_delta_cb(device_name, deltas, count);
+    }
+
+    l_queue_destroy(ctx.removed_paths, l_free);
+    l_queue_destroy(ctx.removed, delta_entry_destroy);
+    l_free(deltas);
+}
+
+static void ordered_networks_delta_clear(void)
+{
+    l_hashmap_destroy(s_reported, delta_device_destroy);
+    s_reported = l_hashmap_string_new();
+}
+
+void iwd_client_ordered_networks_delta_init(void)
+{
+    s_reported = l_hashmap_string_new();
+}
+
+void iwd_client_ordered_networks_delta_deinit(void)
+{
+    l_hashmap_destroy(s_reported, delta_device_destroy);
+    s_reported = NULL;
+}
+
+void iwd_client_set_ordered_networks_delta_cb(uint16_t rssi_threshold100,
+                                              iwd_client_ordered_networks_delta_cb_t delta_cb)
+{
+    s_delta_cb = delta_cb;
+    s_rssi_threshold100 = rssi_threshold100;
+
+    // A new subscriber starts from nothing reported
+    if (s_reported) {
+        ordered_networks_delta_clear();
+    }
+}
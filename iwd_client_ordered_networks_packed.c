@@ -0,0 +1,71 @@
+//****************************************************************************
+//    Copyright (C) 2022 Orbital Systems AB.
+//    All rights reserved
+//****************************************************************************
+#include "iwd_client.h"
+
+#include "iwd_client_internal.h"
+#include "iwd_proxies.h"
+
+#include <assert.h>
+
+// GetOrderedNetworks into iwd_network_packed_t. The call is that of iwd_client_ordered_networks.c, only the
+// decode differs. The cache is not updated as that would need the list anyway.
+
+static void ordered_networks_packed_decode(iwd_client_ordered_networks_oper_t *oper, iwd_status_t status,
+                                           struct l_dbus_message_iter *array)
+{
+    if (status != IWD_STATUS_SUCCESS) {
+        oper->done_cb.packed(status, NULL, oper->user_data);
+        return;
+    }
+
+    // First pass sizes the allocation. Networks that can't be resolved in the second pass leave some slack,
+    // which is given back by iwd_network_packed_finish().
+    struct l_dbus_message_iter size_array = *array;
+    uint32_t max_count = 0;
+    uint32_t strings_size = 1; // Leading empty string
+
+    const char *path;
+    int16_t rssi100;
+    while (l_dbus_message_iter_next_entry(&size_array, &path, &rssi100)) {
+        max_count++;
+        strings_size += strlen(path) + 1;
+
+        const iwd_proxy_props_t *props = iwd_proxies_get_props_by_path(IWD_PROXY_NETWORK, path);
+        if (props && props->known_path) {
+            strings_size += strlen(props->known_path) + 1;
+        }
+    }
+
+    iwd_network_packed_t *networks = iwd_network_packed_new(max_count, strings_size);
+
+    while (l_dbus_message_iter_next_entry(array, &path, &rssi100)) {
+        iwd_network_view_t view;
+        if (!iwd_client_ordered_networks_resolve(path, rssi100, &view)) {
+            continue;
+        }
+
+        iwd_network_packed_add(networks, max_count,
+                               view.name, view.security, view.rssi100, view.connected, view.hidden,
+                               view.path, view.known_path);
+    }
+
+    networks = iwd_network_packed_finish(networks, max_count);
+
+    oper->done_cb.packed(IWD_STATUS_SUCCESS, networks, oper->user_data);
+}
+
+bool iwd_client_ordered_networks_packed_async(const char *device_name,
+                                              iwd_client_ordered_networks_packed_done_cb_t ordered_networks_done_cb,
+                                              void *user_data)
+{
+    assert(ordered_networks_done_cb);
+
+    l_debug("iwd_client: Calling GetOrderedNetworks (packed) on %s", device_name);
+
+    iwd_client_ordered_networks_oper_t *oper =
+        iwd_client_ordered_networks_oper_create(device_name, ordered_networks_packed_decode, user_data);
+    oper->done_cb.packed = ordered_networks_done_cb;
+    return iwd_client_ordered_networks_oper_call(oper);
+}
@@ -0,0 +1,61 @@
+//****************************************************************************
+//    Copyright (C) 2022 Orbital Systems AB.
+//    All rights reserved
+//****************************************************************************
+#include "iwd_client.h"
+
+#include "iwd_client_internal.h"
+#include "iwd_proxies.h"
+
+#include <assert.h>
+
+// GetOrderedNetworks into an array of iwd_network_view_t. The views borrow their strings from the DBUS reply
+// and the proxy properties, so nothing is copied. The call is that of iwd_client_ordered_networks.c, only the
+// decode differs. Like the packed variant, the cache is not updated.
+
+static void ordered_networks_view_decode(iwd_client_ordered_networks_oper_t *oper, iwd_status_t status,
+                                         struct l_dbus_message_iter *array)
+{
+    if (status != IWD_STATUS_SUCCESS) {
+        oper->done_cb.view(status, NULL, 0, oper->user_data);
+        return;
+    }
+
+    // Count first, to have the views in one array
+    struct l_dbus_message_iter count_array = *array;
+    size_t max_count = 0;
+
+    const char *path;
+    int16_t rssi100;
+    while (l_dbus_message_iter_next_entry(&count_array, &path, &rssi100)) {
+        max_count++;
+    }
+
+    iwd_network_view_t *views = l_new(iwd_network_view_t, max_count ? max_count : 1);
+    size_t count = 0;
+
+    while (l_dbus_message_iter_next_entry(array, &path, &rssi100)) {
+        if (iwd_client_ordered_networks_resolve(path, rssi100, &views[count])) {
+            count++;
+        }
+    }
+
+    // Views are valid during the callback only, the reply is freed when we return
+    oper->done_cb.view(IWD_STATUS_SUCCESS, views, count, oper->user_data);
+
+    l_free(views);
+}
+
+bool iwd_client_ordered_networks_view_async(const char *device_name,
+                                            iwd_client_ordered_networks_view_done_cb_t ordered_networks_done_cb,
+                                            void *user_data)
+{
+    assert(ordered_networks_done_cb);
+
+    l_debug("iwd_client: Calling GetOrderedNetworks (view) on %s", device_name);
+
+    iwd_client_ordered_networks_oper_t *oper =
+        iwd_client_ordered_networks_oper_create(device_name, ordered_networks_view_decode, user_data);
+    oper->done_cb.view = ordered_networks_done_cb;
+    return iwd_client_ordered_networks_oper_call(oper);
+}
@@ -4,21 +4,36 @@
 //****************************************************************************
 #include "iwd_client.h"
 
+#include "iwd_client_internal.h"
 #include "iwd_proxies.h"
+#include "iwd_trace.h"
 
 #include <assert.h>
 
+// Scans on the same device are coalesced. Only one Scan call per device is in flight, and every caller
+// asking for a scan meanwhile is added as a waiter to it and gets the same result.
+
 typedef struct {
     iwd_client_scan_started_cb_t done_cb;
     void *user_data;
+    uint64_t start_usec; // l_time_now() at the call
 } scan_oper_t;
 
+typedef struct {
+    char *device_name;
+    struct l_queue *opers; // scan_oper_t waiting for the reply
+    uint32_t trace_seq; // Of the Scan call
+} scan_call_t;
+
+static struct l_hashmap *s_scan_calls; // device_name -> scan_call_t in flight
+
 static scan_oper_t *scan_oper_create(iwd_client_scan_started_cb_t done_cb,
                                      void *user_data)
 {
     scan_oper_t *oper = l_new(scan_oper_t, 1);
     oper->done_cb = done_cb;
     oper->user_data = user_data;
+    oper->start_usec = l_time_now();
     return oper;
 }
 
@@ -26,6 +41,7 @@ static void scan_oper_run_callback(scan_oper_t *oper, iwd_status_t status)
 {
     assert(oper);
     assert(oper->done_cb);
+    iwd_stats_record(IWD_OPER_SCAN, status, oper->start_usec);
     oper->done_cb(status, oper->user_data);
     oper->done_cb = NULL; // Mark it called
 }
@@ -42,18 +58,43 @@ static void scan_oper_destroy(scan_oper_t *oper)
     l_free(oper);
 }
 
+static void scan_oper_destroy_void(void *data)
+{
+    scan_oper_destroy(data);
+}
+
 static void scan_oper_error_and_destroy(scan_oper_t *oper, iwd_status_t status)
 {
     scan_oper_run_callback(oper, status);
     scan_oper_destroy(oper);
 }
 
-static void scan_reply_handler(__attribute__((unused)) struct l_dbus_proxy *unused_proxy,
+static scan_call_t *scan_call_create(const char *device_name)
+{
+    scan_call_t *call = l_new(scan_call_t, 1);
+    call->device_name = l_strdup(device_name);
+    call->opers = l_queue_new();
+    return call;
+}
+
+static void scan_call_destroy(scan_call_t *call)
+{
+    l_queue_destroy(call->opers, scan_oper_destroy_void);
+    l_free(call->device_name);
+    l_free(call);
+}
+
+static void scan_reply_handler(struct l_dbus_proxy *proxy,
                                struct l_dbus_message *msg,
                                void *user_data)
 {
-    scan_oper_t *oper = (scan_oper_t *)user_data;
-    assert(oper);
+    scan_call_t *call = (scan_call_t *)user_data;
+    assert(call);
+
+    iwd_trace_reply(proxy, "Scan", msg, call->trace_seq);
+
+    // No new waiters from here on. A new scan request will make a new call.
+    l_hashmap_remove(s_scan_calls, call->device_name);
 
     iwd_status_t status = IWD_STATUS_SUCCESS;
 
@@ -68,15 +109,46 @@ static void scan_reply_handler(__attribute__((unused)) struct l_dbus_proxy *unus
         // net.connman.iwd.Busy
         // net.connman.iwd.Failed
         status = iwd_status_parse_dbus_error(name);
+
+        // If a scan has started meanwhile, that is as good as our own
+        if (status == IWD_STATUS_BUSY || status == IWD_STATUS_IN_PROGRESS) {
+            struct l_dbus_proxy *proxy_station = iwd_proxies_get_station_for_device(call->device_name);
+            const iwd_proxy_props_t *props = proxy_station ? iwd_proxies_get_props(proxy_station) : NULL;
+            if (props && props->scanning) {
+                l_info("iwd_client: Scan on %s is already running", call->device_name);
+                status = IWD_STATUS_SUCCESS;
+            }
+        }
     }
 
-    scan_oper_run_callback(oper, status);
+    scan_oper_t *oper;
+    while ((oper = l_queue_pop_head(call->opers))) {
+        scan_oper_error_and_destroy(oper, status);
+    }
 }
 
 static void scan_destroy_handler(void *user_data)
 {
-    scan_oper_t *oper = (scan_oper_t *)user_data;
-    scan_oper_destroy(oper);
+    scan_call_t *call = (scan_call_t *)user_data;
+
+    // Still in the map if the call was aborted before the reply
+    if (l_hashmap_lookup(s_scan_calls, call->device_name) == call) {
+        l_hashmap_remove(s_scan_calls, call->device_name);
+    }
+
+    scan_call_destroy(call); // Opers left get IWD_STATUS_DBUS_ABORTED
+}
+
+void iwd_client_scan_init(void)
+{
+    s_scan_calls = l_hashmap_string_new();
+}
+
+void iwd_client_scan_deinit(void)
+{
+    // All calls are destroyed together with the DBUS client, which takes them out of the map
+    l_hashmap_destroy(s_scan_calls, NULL);
+    s_scan_calls = NULL;
 }
 
 bool iwd_client_scan_start_async(const char *device_name,
@@ -96,15 +168,39 @@ bool iwd_client_scan_start_async(const char *device_name,
         return false;
     }
 
+    // Attach to a Scan call already in flight
+    scan_call_t *call = l_hashmap_lookup(s_scan_calls, device_name);
+    if (call) {
+        l_debug("iwd_client: Scan on %s is already called. Waiting for its reply", device_name);
+        l_queue_push_tail(call->opers, oper);
+        return true;
+    }
+
+    // Attach to a scan already running
+    const iwd_proxy_props_t *props = iwd_proxies_get_props(proxy_station);
+    if (props && props->scanning) {
+        l_info("iwd_client: Scan on %s is already running", device_name);
+        scan_oper_error_and_destroy(oper, IWD_STATUS_SUCCESS);
+        return true;
+    }
+
+    call = scan_call_create(device_name);
+    l_queue_push_tail(call->opers, oper);
+
+    call->trace_seq = iwd_trace_call(proxy_station, "Scan");
     uint32_t callid = l_dbus_proxy_method_call(proxy_station, "Scan",
                                                NULL, // No arguments needs setup into message
                                                scan_reply_handler,
-                                               oper, // user_data
+                                               call, // user_data
                                                scan_destroy_handler);
     if (callid == 0) {
+        l_queue_remove(call->opers, oper);
+        scan_call_destroy(call);
         scan_oper_error_and_destroy(oper, IWD_STATUS_DBUS_SEND_FAILED);
         return false;
     }
 
+    l_hashmap_insert(s_scan_calls, device_name, call);
+
     return true;
 }
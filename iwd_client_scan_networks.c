@@ -0,0 +1,264 @@
+//****************************************************************************
+//    Copyright (C) 2022 Orbital Systems AB.
+//    All rights reserved
+//****************************************************************************
+#include "iwd_client.h"
+
+#include "iwd_client_internal.h"
+#include "iwd_proxies.h"
+#include "iwd_util.h"
+
+#include <assert.h>
+
+// Scan, wait for the scan to finish and then get the ordered networks. When the scan finishes the cache is
+// refreshed anyway, so the result of that refresh is used instead of a GetOrderedNetworks of our own.
+
+typedef enum {
+    SCAN_NETWORKS_STATE_SCAN, // Scan is called
+    SCAN_NETWORKS_STATE_WAIT_SCAN, // Waiting for Scanning to become false
+    SCAN_NETWORKS_STATE_WAIT_REFRESH, // Waiting for the cache refresh after the scan
+    SCAN_NETWORKS_STATE_FETCH, // GetOrderedNetworks is called
+} scan_networks_state_t;
+
+typedef struct {
+    iwd_client_ordered_networks_done_cb_t done_cb; // NULL when called
+    void *user_data;
+    char *device_name;
+    scan_networks_state_t state;
+    uint32_t wait_request; // SCAN_NETWORKS_STATE_WAIT_REFRESH: Lowest request of a cache update to use
+    struct l_timeout *timeout;
+    unsigned int pending; // Number of DBUS calls in flight using this oper. Must be 0 before oper is freed
+} scan_networks_oper_t;
+
+static struct l_queue *s_scan_networks_opers; // scan_networks_oper_t not yet called back
+
+static scan_networks_oper_t *scan_networks_oper_create(iwd_client_ordered_networks_done_cb_t done_cb,
+                                                       void *user_data,
+                                                       const char *device_name)
+{
+    scan_networks_oper_t *oper = l_new(scan_networks_oper_t, 1);
+    oper->done_cb = done_cb;
+    oper->user_data = user_data;
+    oper->device_name = l_strdup(device_name);
+    oper->state = SCAN_NETWORKS_STATE_SCAN;
+    return oper;
+}
+
+static void scan_networks_oper_free(scan_networks_oper_t *oper)
+{
+    assert(oper->done_cb == NULL);
+    assert(oper->pending == 0);
+
+    l_free(oper->device_name);
+    l_free(oper);
+}
+
+// Runs the callback. Oper is freed now, or when the last DBUS call in flight is done.
+static void scan_networks_oper_complete(scan_networks_oper_t *oper, iwd_status_t status, struct l_queue *networks)
+{
+    assert(oper);
+    assert(oper->done_cb);
+
+    l_timeout_remove(oper->timeout);
+    oper->timeout = NULL;
+    l_queue_remove(s_scan_networks_opers, oper);
+
+    oper->done_cb(status, networks, oper->user_data);
+    oper->done_cb = NULL; // Mark it called
+
+    if (oper->pending == 0) {
+        scan_networks_oper_free(oper);
+    }
+}
+
+// A DBUS call using oper is done
+static void scan_networks_oper_unpend(scan_networks_oper_t *oper)
+{
+    assert(oper->pending > 0);
+    oper->pending--;
+
+    if (oper->done_cb == NULL && oper->pending == 0) {
+        scan_networks_oper_free(oper);
+    }
+}
+
+static void scan_networks_fetch_done(iwd_status_t status, struct l_queue *networks, void *user_data)
+{
+    scan_networks_oper_t *oper = user_data;
+
+    if (oper->done_cb) {
+        scan_networks_oper_complete(oper, status, networks);
+    }
+    else {
+        // Already timed out
+        iwd_network_list_destroy(networks);
+    }
+
+    scan_networks_oper_unpend(oper);
+}
+
+static void scan_networks_fetch(scan_networks_oper_t *oper)
+{
+    oper->state = SCAN_NETWORKS_STATE_FETCH;
+
+    // Callback is always called, also on early errors
+    oper->pending++;
+    iwd_client_ordered_networks_async(oper->device_name, scan_networks_fetch_done, oper);
+}
+
+static void scan_networks_timeout(__attribute__((unused)) struct l_timeout *timeout, void *user_data)
+{
+    scan_networks_oper_t *oper = user_data;
+
+    l_error("iwd_client: Scan and get ordered networks on %s timed out", oper->device_name);
+    scan_networks_oper_complete(oper, IWD_STATUS_TIMEOUT, NULL);
+}
+
+static bool scan_networks_is_scanning(const char *device_name)
+{
+    struct l_dbus_proxy *proxy_station = iwd_proxies_get_station_for_device(device_name);
+    const iwd_proxy_props_t *props = proxy_station ? iwd_proxies_get_props(proxy_station) : NULL;
+    return props && props->scanning;
+}
+
+static void scan_networks_scan_started(iwd_status_t status, void *user_data)
+{
+    scan_networks_oper_t *oper = user_data;
+
+    if (oper->done_cb && oper->state == SCAN_NETWORKS_STATE_SCAN) { // Not timed out or already finished
+        if (status == IWD_STATUS_SUCCESS || status == IWD_STATUS_IN_PROGRESS ||
+            (status == IWD_STATUS_BUSY && scan_networks_is_scanning(oper->device_name))) {
+            // Scan started, or a scan is already running that we can wait for. Busy with anything else
+            // (connecting, ...) gives no scan that finishes.
+            oper->state = SCAN_NETWORKS_STATE_WAIT_SCAN;
+        }
+        else {
+            scan_networks_oper_complete(oper, status, NULL);
+        }
+    }
+
+    scan_networks_oper_unpend(oper);
+}
+
+// Opers on device_name in one of the states, in a new queue. The list can't be iterated directly as it is
+// modified by callbacks and early errors.
+static struct l_queue *scan_networks_opers_in(const char *device_name, scan_networks_state_t first,
+                                              scan_networks_state_t last)
+{
+    struct l_queue *opers = l_queue_new();
+
+    for (const struct l_queue_entry *entry = l_queue_get_entries(s_scan_networks_opers); entry; entry = entry->next) {
+        scan_networks_oper_t *oper = entry->data;
+
+        if (oper->state >= first && oper->state <= last && streq(oper->device_name, device_name)) {
+            l_queue_push_tail(opers, oper);
+        }
+    }
+
+    return opers;
+}
+
+void iwd_client_scan_networks_scan_finished(const char *device_name)
+{
+    // The cache refresh of the finished scan is already called
+    uint32_t wait_request = iwd_client_ordered_networks_cache_refresh_wait(device_name);
+
+    // Also opers that still waits for the Scan reply. The finish could come before the reply.
+    struct l_queue *finished = scan_networks_opers_in(device_name, SCAN_NETWORKS_STATE_SCAN,
+                                                      SCAN_NETWORKS_STATE_WAIT_SCAN);
+
+    for (const struct l_queue_entry *entry = l_queue_get_entries(finished); entry; entry = entry->next) {
+        scan_networks_oper_t *oper = entry->data;
+
+        if (wait_request) {
+            oper->state = SCAN_NETWORKS_STATE_WAIT_REFRESH;
+            oper->wait_request = wait_request;
+        }
+        else {
+            scan_networks_fetch(oper);
+        }
+    }
+
+    l_queue_destroy(finished, NULL);
+}
+
+void iwd_client_scan_networks_cache_updated(const char *device_name, uint32_t request, struct l_queue *networks)
+{
+    struct l_queue *waiting = scan_networks_opers_in(device_name, SCAN_NETWORKS_STATE_WAIT_REFRESH,
+                                                     SCAN_NETWORKS_STATE_WAIT_REFRESH);
+
+    for (const struct l_queue_entry *entry = l_queue_get_entries(waiting); entry; entry = entry->next) {
+        scan_networks_oper_t *oper = entry->data;
+
+        if (request >= oper->wait_request) {
+            scan_networks_oper_complete(oper, IWD_STATUS_SUCCESS, iwd_network_list_copy(networks));
+        }
+    }
+
+    l_queue_destroy(waiting, NULL);
+}
+
+void iwd_client_scan_networks_refresh_done(const char *device_name)
+{
+    struct l_queue *waiting = scan_networks_opers_in(device_name, SCAN_NETWORKS_STATE_WAIT_REFRESH,
+                                                     SCAN_NETWORKS_STATE_WAIT_REFRESH);
+
+    for (const struct l_queue_entry *entry = l_queue_get_entries(waiting); entry; entry = entry->next) {
+        scan_networks_oper_t *oper = entry->data;
+
+        // The refresh failed, or its result was from before the scan
+        scan_networks_fetch(oper);
+    }
+
+    l_queue_destroy(waiting, NULL);
+}
+
+void iwd_client_scan_networks_init(void)
+{
+    s_scan_networks_opers = l_queue_new();
+}
+
+void iwd_client_scan_networks_deinit(void)
+{
+    // Opers left are only waiting for the scan to finish, which will not happen now
+    scan_networks_oper_t *oper;
+    while ((oper = l_queue_peek_head(s_scan_networks_opers))) {
+        scan_networks_oper_complete(oper, IWD_STATUS_DBUS_ABORTED, NULL);
+    }
+
+    l_queue_destroy(s_scan_networks_opers, NULL);
+    s_scan_networks_opers = NULL;
+}
+
+bool iwd_client_scan_ordered_networks_async(const char *device_name,
+                                            uint32_t timeout_ms,
+                                            iwd_client_ordered_networks_done_cb_t done_cb,
+                                            void *user_data)
+{
+    assert(done_cb);
+    assert(timeout_ms > 0);
+
+    l_info("iwd_client: Scan and get ordered networks on %s", device_name);
+
+    if (!iwd_proxies_get_station_for_device(device_name)) {
+        l_error("iwd_client: Station for device='%s' is not found", device_name);
+        done_cb(IWD_STATUS_STATION_NOT_FOUND, NULL, user_data);
+        return false;
+    }
+
+    scan_networks_oper_t *oper = scan_networks_oper_create(done_cb, user_data, device_name);
+    l_queue_push_tail(s_scan_networks_opers, oper);
+    oper->timeout = l_timeout_create_ms(timeout_ms, scan_networks_timeout, oper, NULL);
+
+    // Held over the start, so that oper is still here to tell if it was completed by an early error
+    oper->pending++;
+
+    // Scans are coalesced, so this also attaches to a scan that is already running or called.
+    // Callback is always called, also on early errors.
+    oper->pending++;
+    iwd_client_scan_start_async(device_name, scan_networks_scan_started, oper);
+
+    bool completed = oper->done_cb == NULL;
+    scan_networks_oper_unpend(oper);
+    return !completed;
+}
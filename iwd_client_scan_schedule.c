@@ -0,0 +1,220 @@
+//****************************************************************************
+//    Copyright (C) 2022 Orbital Systems AB.
+//    All rights reserved
+//****************************************************************************
+#include "iwd_client.h"
+
+#include "iwd_client_internal.h"
+#include "iwd_proxies.h"
+
+#include <assert.h>
+
+// Background scans on every ready device, with an interval adapted to the connection.
+// Disconnected: scan every disconnected_interval_ms to find a network.
+// Connected: start at connected_min_interval_ms and double it after each result where the connected network is
+// strong and not falling, up to connected_max_interval_ms. Back to the minimum when it is weak or falling.
+// Any finished scan, also those not started here, gives a result through the cache refresh that follows it and
+// restarts the interval, so the scheduler never scans right after someone else did. Other fetches of the ordered
+// networks are no scan results and leave the schedule alone. No scans while a connect is in flight.
+
+typedef struct {
+    char *device_name;
+    struct l_timeout *timeout;
+    uint32_t interval_ms; // Current interval
+    bool has_rssi; // last_rssi100 is from a result while connected
+    int16_t last_rssi100; // Of the connected network in the last result
+} schedule_device_t;
+
+static bool s_running;
+static iwd_scan_schedule_t s_schedule;
+
+static struct l_hashmap *s_devices; // device_name -> schedule_device_t
+
+static void schedule_device_destroy(void *data)
+{
+    schedule_device_t *device = data;
+
+    l_timeout_remove(device->timeout);
+    l_free(device->device_name);
+    l_free(device);
+}
+
+static void schedule_device_arm(schedule_device_t *device)
+{
+    l_debug("iwd_client: Next background scan on %s in %u ms", device->device_name, device->interval_ms);
+    l_timeout_modify_ms(device->timeout, device->interval_ms);
+}
+
+// Interval to start from when the connected network of the device is set or cleared
+static void schedule_device_restart(schedule_device_t *device, bool connected)
+{
+    device->interval_ms = connected ? s_schedule.connected_min_interval_ms : s_schedule.disconnected_interval_ms;
+    device->has_rssi = false;
+    schedule_device_arm(device);
+}
+
+static void schedule_scan_done(iwd_status_t status, void *user_data)
+{
+    char *device_name = user_data;
+
+    // Next scan is already armed. The result reaches the cache when the scan finishes.
+    if (status != IWD_STATUS_SUCCESS) {
+        l_warn("iwd_client: Background scan on %s failed with status=%d", device_name, status);
+    }
+    l_free(device_name);
+}
+
+static void schedule_timeout(__attribute__((unused)) struct l_timeout *timeout, void *user_data)
+{
+    schedule_device_t *device = user_data;
+
+    // Armed again right away, in case this scan gives no result. A result re-arms it from there.
+    schedule_device_arm(device);
+
+    if (iwd_client_connect_in_progress(device->device_name)) {
+        l_debug("iwd_client: Connect in progress on %s. Skipping background scan", device->device_name);
+        return;
+    }
+
+    l_debug("iwd_client: Background scan on %s", device->device_name);
+    iwd_client_scan_start_async(device->device_name, schedule_scan_done, l_strdup(device->device_name));
+}
+
+static void schedule_device_add(const char *device_name, bool connected)
+{
+    if (l_hashmap_lookup(s_devices, device_name)) {
+        return;
+    }
+
+    schedule_device_t *device = l_new(schedule_device_t, 1);
+    device->device_name = l_strdup(device_name);
+    device->interval_ms = connected ? s_schedule.connected_min_interval_ms : s_schedule.disconnected_interval_ms;
+    device->timeout = l_timeout_create_ms(device->interval_ms, schedule_timeout, device, NULL);
+    l_hashmap_insert(s_devices, device_name, device);
+}
+
+static void schedule_each_station(struct l_dbus_proxy *proxy, const iwd_proxy_props_t *props,
+                                  __attribute__((unused)) void *user_data)
+{
+    const char *device_name = iwd_proxies_get_device_name_for_station(proxy);
+    if (device_name) {
+        schedule_device_add(device_name, props->connected_path != NULL);
+    }
+}
+
+void iwd_client_scan_schedule_device_ready(const char *device_name)
+{
+    if (!s_running) {
+        return;
+    }
+
+    struct l_dbus_proxy *proxy_station = iwd_proxies_get_station_for_device(device_name);
+    const iwd_proxy_props_t *props = proxy_station ? iwd_proxies_get_props(proxy_station) : NULL;
+    schedule_device_add(device_name, props && props->connected_path);
+}
+
+void iwd_client_scan_schedule_device_gone(const char *device_name)
+{
+    schedule_device_t *device = l_hashmap_remove(s_devices, device_name);
+    if (device) {
+        schedule_device_destroy(device);
+    }
+}
+
+void iwd_client_scan_schedule_connected_network(const char *device_name, const char *connected_path)
+{
+    schedule_device_t *device = l_hashmap_lookup(s_devices, device_name);
+    if (device) {
+        schedule_device_restart(device, connected_path != NULL);
+    }
+}
+
+void iwd_client_scan_schedule_networks_updated(const char *device_name, struct l_queue *networks)
+{
+    schedule_device_t *device = l_hashmap_lookup(s_devices, device_name);
+    if (device == NULL) {
+        return;
+    }
+
+    const iwd_network_t *connected = NULL;
+    for (const struct l_queue_entry *entry = l_queue_get_entries(networks); entry; entry = entry->next) {
+        const iwd_network_t *network = entry->data;
+        if (network->connected) {
+            connected = network;
+            break;
+        }
+    }
+
+    if (connected == NULL) {
+        device->interval_ms = s_schedule.disconnected_interval_ms;
+        device->has_rssi = false;
+    }
+    else {
+        bool weak = connected->rssi100 <= s_schedule.weak_rssi100;
+        bool falling = device->has_rssi && device->last_rssi100 - connected->rssi100 >= s_schedule.falling_rssi100;
+
+        if (weak || falling || device->interval_ms < s_schedule.connected_min_interval_ms) {
+            device->interval_ms = s_schedule.connected_min_interval_ms;
+        }
+        else if (device->interval_ms < s_schedule.connected_max_interval_ms / 2) {
+            device->interval_ms *= 2;
+        }
+        else {
+            device->interval_ms = s_schedule.connected_max_interval_ms;
+        }
+
+        l_debug("iwd_client: Connected network on %s at rssi=%d%s%s", device_name, connected->rssi100,
+                weak ? " weak" : "", falling ? " falling" : "");
+
+        device->has_rssi = true;
+        device->last_rssi100 = connected->rssi100;
+    }
+
+    schedule_device_arm(device);
+}
+
+void iwd_client_scan_schedule_clear(void)
+{
+    l_hashmap_destroy(s_devices, schedule_device_destroy);
+    s_devices = l_hashmap_string_new();
+}
+
+void iwd_client_scan_schedule_init(void)
+{
+    s_devices = l_hashmap_string_new();
+}
+
+void iwd_client_scan_schedule_deinit(void)
+{
+    l_hashmap_destroy(s_devices, schedule_device_destroy);
+    s_devices = NULL;
+    s_running = false;
+}
+
+void iwd_client_scan_schedule_start(const iwd_scan_schedule_t *schedule)
+{
+    assert(schedule);
+    assert(schedule->disconnected_interval_ms > 0);
+    assert(schedule->connected_min_interval_ms > 0);
+    assert(schedule->connected_max_interval_ms >= schedule->connected_min_interval_ms);
+    assert(schedule->falling_rssi100 > 0);
+
+    l_info("iwd_client: Background scans every %u ms when disconnected, %u-%u ms when connected",
+           schedule->disconnected_interval_ms, schedule->connected_min_interval_ms,
+           schedule->connected_max_interval_ms);
+
+    s_schedule = *schedule;
+    s_running = true;
+
+    // Start over with the new schedule. Devices that are ready later are added by iwd_client.c.
+    iwd_client_scan_schedule_clear();
+    iwd_proxies_foreach_station(schedule_each_station, NULL);
+}
+
+void iwd_client_scan_schedule_stop(void)
+{
+    l_info("iwd_client: Background scans stopped");
+
+    s_running = false;
+    iwd_client_scan_schedule_clear();
+}
@@ -0,0 +1,187 @@
+//****************************************************************************
+//    Copyright (C) 2022 Orbital Systems AB.
+//    All rights reserved
+//****************************************************************************
+#include "iwd_client.h"
+
+#include "iwd_agent.h"
+#include "iwd_client_internal.h"
+#include "iwd_proxies.h"
+
+#include <assert.h>
+#include <string.h>
+
+// Signal level of the connected network, pushed by iwd to the SignalLevelAgent in iwd_agent.c.
+// The thresholds of a device are kept here, and registered again every time the device becomes ready,
+// so they survive the device or iwd going away and coming back.
+
+typedef struct {
+    char *device_name;
+    int16_t levels_dbm[IWD_SIGNAL_LEVELS_MAX];
+    size_t count;
+    iwd_client_signal_level_cb_t signal_level_cb;
+    bool registered; // RegisterSignalLevelAgent is called on the current station of the device
+    uint32_t registration; // Of the last RegisterSignalLevelAgent. A failure of an earlier one is too old to count.
+} signal_level_t;
+
+static struct l_hashmap *s_signal_levels; // device_name -> signal_level_t
+static uint32_t s_registration; // Last registration, over all devices, so a replaced entry can't get the same
+
+static void signal_level_destroy(void *data)
+{
+    signal_level_t *signal_level = data;
+
+    l_free(signal_level->device_name);
+    l_free(signal_level);
+}
+
+static void signal_level_register(signal_level_t *signal_level)
+{
+    struct l_dbus_proxy *proxy_station = iwd_proxies_get_station_for_device(signal_level->device_name);
+    if (proxy_station == NULL) {
+        return; // Registered when the device is ready
+    }
+
+    l_info("iwd_client: Registering signal level agent on %s with %zu levels",
+           signal_level->device_name, signal_level->count);
+    signal_level->registration = ++s_registration;
+    signal_level->registered = iwd_agent_register_signal_level_agent(proxy_station, signal_level->device_name,
+                                                                     signal_level->registration,
+                                                                     signal_level->levels_dbm,
+                                                                     signal_level->count);
+}
+
+static void signal_level_unregister(signal_level_t *signal_level)
+{
+    if (!signal_level->registered) {
+        return;
+    }
+    signal_level->registered = false;
+
+    struct l_dbus_proxy *proxy_station = iwd_proxies_get_station_for_device(signal_level->device_name);
+    if (proxy_station) {
+        iwd_agent_unregister_signal_level_agent(proxy_station);
+    }
+}
+
+static signal_level_t *signal_level_for_path(const char *device_path)
+{
+    struct l_dbus_proxy *proxy_station = iwd_proxies_get_station(device_path);
+    const char *device_name = proxy_station ? iwd_proxies_get_device_name_for_station(proxy_station) : NULL;
+    return device_name ? l_hashmap_lookup(s_signal_levels, device_name) : NULL;
+}
+
+void iwd_client_signal_level_agent_changed(const char *device_path, uint8_t level)
+{
+    signal_level_t *signal_level = signal_level_for_path(device_path);
+    if (signal_level == NULL) {
+        l_warn("iwd_client: Signal level %u on unknown device path='%s'", level, device_path);
+        return;
+    }
+
+    l_debug("iwd_client: Signal level on %s changed to %u", signal_level->device_name, level);
+    signal_level->signal_level_cb(signal_level->device_name, level);
+}
+
+void iwd_client_signal_level_agent_released(const char *device_path)
+{
+    signal_level_t *signal_level = signal_level_for_path(device_path);
+    if (signal_level) {
+        signal_level->registered = false;
+    }
+}
+
+void iwd_client_signal_level_agent_register_failed(const char *device_name, uint32_t registration)
+{
+    signal_level_t *signal_level = l_hashmap_lookup(s_signal_levels, device_name);
+    if (signal_level && signal_level->registration == registration) {
+        signal_level->registered = false; // Registered again when the device is ready again
+    }
+}
+
+void iwd_client_signal_level_device_ready(const char *device_name)
+{
+    signal_level_t *signal_level = l_hashmap_lookup(s_signal_levels, device_name);
+    if (signal_level && !signal_level->registered) {
+        signal_level_register(signal_level);
+    }
+}
+
+void iwd_client_signal_level_device_gone(const char *device_name)
+{
+    signal_level_t *signal_level = l_hashmap_lookup(s_signal_levels, device_name);
+    if (signal_level) {
+        signal_level->registered = false; // Gone with the station
+    }
+}
+
+static void signal_level_reset_registered(__attribute__((unused)) const void *key, void *value,
+                                          __attribute__((unused)) void *user_data)
+{
+    signal_level_t *signal_level = value;
+
+    signal_level->registered = false;
+}
+
+void iwd_client_signal_level_clear(void)
+{
+    l_hashmap_foreach(s_signal_levels, signal_level_reset_registered, NULL);
+}
+
+void iwd_client_signal_level_init(void)
+{
+    s_signal_levels = l_hashmap_string_new();
+}
+
+void iwd_client_signal_level_deinit(void)
+{
+    l_hashmap_destroy(s_signal_levels, signal_level_destroy);
+    s_signal_levels = NULL;
+}
+
+bool iwd_client_set_signal_level_cb(const char *device_name,
+                                    const int16_t *thresholds_rssi100,
+                                    size_t count,
+                                    iwd_client_signal_level_cb_t signal_level_cb)
+{
+    assert(device_name);
+
+    // Checked before the old thresholds are replaced, so a bad call leaves them working
+    int16_t levels_dbm[IWD_SIGNAL_LEVELS_MAX];
+    if (signal_level_cb) {
+        if (count == 0 || count > IWD_SIGNAL_LEVELS_MAX) {
+            l_error("iwd_client: Signal level on %s needs 1 to %u thresholds, got %zu",
+                    device_name, IWD_SIGNAL_LEVELS_MAX, count);
+            return false;
+        }
+
+        for (size_t i = 0; i < count; i++) {
+            levels_dbm[i] = thresholds_rssi100[i] / 100; // iwd takes whole dBm
+            if (i > 0 && levels_dbm[i] >= levels_dbm[i - 1]) {
+                l_error("iwd_client: Signal level thresholds on %s must be strongest first, 1 dBm apart",
+                        device_name);
+                return false;
+            }
+        }
+    }
+
+    signal_level_t *old = l_hashmap_remove(s_signal_levels, device_name);
+    if (old) {
+        signal_level_unregister(old);
+        signal_level_destroy(old);
+    }
+
+    if (signal_level_cb == NULL) {
+        return true;
+    }
+
+    signal_level_t *signal_level = l_new(signal_level_t, 1);
+    memcpy(signal_level->levels_dbm, levels_dbm, count * sizeof(levels_dbm[0]));
+    signal_level->device_name = l_strdup(device_name);
+    signal_level->count = count;
+    signal_level->signal_level_cb = signal_level_cb;
+    l_hashmap_insert(s_signal_levels, device_name, signal_level);
+
+    signal_level_register(signal_level);
+    return true;
+}
@@ -0,0 +1,672 @@
+//****************************************************************************
+//    Copyright (C) 2022 Orbital Systems AB.
+//    All rights reserved
+//****************************************************************************
+#include "iwd_client.h"
+
+#include "iwd_client_internal.h"
+#include "iwd_proxies.h"
+#include "iwd_snapshot.h"
+#include "iwd_util.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+// Warm-start snapshot. The file loaded at start is kept mapped and served as stale data. A new file is written
+// atomically (temporary file + rename) when the main loop is idle after a change, so bursts give one write.
+// The written data then replaces the mapping, so what is served, re-seeded after a reconnect and carried over
+// for devices without live networks is always the last snapshot.
+// Most changes are only the signal after a scan. Writes are at most every SNAPSHOT_SAVE_INTERVAL_MS, and
+// skipped when nothing but the signal and order of the networks has changed, to spare flash storage.
+
+#define SNAPSHOT_SAVE_INTERVAL_MS 30000
+
+static char *s_path; // NULL when snapshots are not used
+static struct l_idle *s_save_idle;
+static struct l_timeout *s_save_timeout; // Save delayed until SNAPSHOT_SAVE_INTERVAL_MS after the last write
+static uint64_t s_saved_usec; // l_time_now() of the last write. 0 if none.
+
+static const uint8_t *s_map; // Last snapshot, loaded or saved. NULL if none.
+static size_t s_map_size;
+static bool s_map_mapped; // s_map is the mapped file, else allocated by the last save
+
+//
+// Loaded snapshot
+//
+
+static const iwd_snapshot_header_t *snapshot_header(void)
+{
+    return (const iwd_snapshot_header_t *)s_map;
+}
+
+static const iwd_snapshot_device_t *snapshot_devices(void)
+{
+    return (const iwd_snapshot_device_t *)(s_map + sizeof(iwd_snapshot_header_t));
+}
+
+static const iwd_network_record_t *snapshot_networks(void)
+{
+    return (const iwd_network_record_t *)(snapshot_devices() + snapshot_header()->device_count);
+}
+
+static const iwd_snapshot_known_t *snapshot_known(void)
+{
+    return (const iwd_snapshot_known_t *)(snapshot_networks() + snapshot_header()->network_count);
+}
+
+static const char *snapshot_strings(void)
+{
+    return (const char *)(snapshot_known() + snapshot_header()->known_count);
+}
+
+static const char *snapshot_string(uint32_t offset)
+{
+    return snapshot_strings() + offset;
+}
+
+// A corrupt file can hold any value in a bool or an enum, so they are checked as the integers they are stored as
+_Static_assert(sizeof(bool) == sizeof(uint8_t), "bool is checked as uint8_t");
+_Static_assert(sizeof(iwd_security_t) == sizeof(uint32_t), "iwd_security_t is checked as uint32_t");
+
+static bool snapshot_bool_valid(const bool *field)
+{
+    uint8_t value;
+    memcpy(&value, field, sizeof(value));
+    return value <= 1;
+}
+
+static bool snapshot_security_valid(const iwd_security_t *field)
+{
+    uint32_t value;
+    memcpy(&value, field, sizeof(value));
+    return value <= IWD_SECURITY_HOTSPOT;
+}
+
+// Everything is checked once here, so the accessors can trust the content
+static bool snapshot_validate(const uint8_t *map, size_t size)
+{
+    const iwd_snapshot_header_t *header = (const iwd_snapshot_header_t *)map;
+
+    if (size < sizeof(iwd_snapshot_header_t) || header->magic != IWD_SNAPSHOT_MAGIC) {
+        l_error("iwd_client: Snapshot is not a snapshot");
+        return false;
+    }
+
+    if (header->version != IWD_SNAPSHOT_VERSION || header->header_size != sizeof(iwd_snapshot_header_t)) {
+        l_warn("iwd_client: Snapshot version %u is not supported", header->version);
+        return false;
+    }
+
+    uint64_t layout_size = sizeof(iwd_snapshot_header_t) +
+                           (uint64_t)header->device_count * sizeof(iwd_snapshot_device_t) +
+                           (uint64_t)header->network_count * sizeof(iwd_network_record_t) +
+                           (uint64_t)header->known_count * sizeof(iwd_snapshot_known_t) +
+                           header->strings_size;
+    if (header->size != size || layout_size != size || header->strings_size == 0) {
+        l_error("iwd_client: Snapshot size=%zu does not match its content", size);
+        return false;
+    }
+
+    const char *strings = (const char *)(map + size - header->strings_size);
+    if (strings[0] != '\0' || strings[header->strings_size - 1] != '\0') {
+        l_error("iwd_client: Snapshot strings are not terminated");
+        return false;
+    }
+
+    const iwd_snapshot_device_t *devices = (const iwd_snapshot_device_t *)(header + 1);
+    for (uint32_t i = 0; i < header->device_count; i++) {
+        if (devices[i].first_network > header->network_count ||
+            devices[i].network_count > header->network_count - devices[i].first_network ||
+            !snapshot_bool_valid(&devices[i].has_networks) ||
+            memchr(devices[i].name, '\0', sizeof(devices[i].name)) == NULL ||
+            memchr(devices[i].connected_ssid, '\0', sizeof(devices[i].connected_ssid)) == NULL) {
+            l_error("iwd_client: Snapshot device %u is broken", i);
+            return false;
+        }
+    }
+
+    const iwd_network_record_t *networks = (const iwd_network_record_t *)(devices + header->device_count);
+    for (uint32_t i = 0; i < header->network_count; i++) {
+        if (networks[i].path_offset >= header->strings_size ||
+            networks[i].known_path_offset >= header->strings_size ||
+            !snapshot_security_valid(&networks[i].security) ||
+            !snapshot_bool_valid(&networks[i].connected) ||
+            !snapshot_bool_valid(&networks[i].hidden) ||
+            memchr(networks[i].name, '\0', sizeof(networks[i].name)) == NULL) {
+            l_error("iwd_client: Snapshot network %u is broken", i);
+            return false;
+        }
+    }
+
+    const iwd_snapshot_known_t *known = (const iwd_snapshot_known_t *)(networks + header->network_count);
+    for (uint32_t i = 0; i < header->known_count; i++) {
+        if (known[i].path_offset >= header->strings_size ||
+            !snapshot_security_valid(&known[i].security) ||
+            !snapshot_bool_valid(&known[i].hidden) ||
+            memchr(known[i].name, '\0', sizeof(known[i].name)) == NULL) {
+            l_error("iwd_client: Snapshot known network %u is broken", i);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool snapshot_load(const char *path)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        if (errno != ENOENT) {
+            l_error("iwd_client: Can't open snapshot '%s': %s", path, strerror(errno));
+        }
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size == 0) {
+        close(fd);
+        return false;
+    }
+
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); // The mapping keeps the file
+    if (map == MAP_FAILED) {
+        l_error("iwd_client: Can't map snapshot '%s': %s", path, strerror(errno));
+        return false;
+    }
+
+    if (!snapshot_validate(map, st.st_size)) {
+        munmap(map, st.st_size);
+        return false;
+    }
+
+    s_map = map;
+    s_map_size = st.st_size;
+    s_map_mapped = true;
+
+    l_info("iwd_client: Loaded snapshot '%s' from %lld with %u devices, %u networks and %u known networks",
+           path, (long long)snapshot_header()->saved_time, snapshot_header()->device_count,
+           snapshot_header()->network_count, snapshot_header()->known_count);
+    return true;
+}
+
+static void snapshot_release(void)
+{
+    if (s_map_mapped) {
+        munmap((void *)s_map, s_map_size);
+    }
+    else {
+        l_free((void *)s_map);
+    }
+    s_map = NULL;
+    s_map_size = 0;
+    s_map_mapped = false;
+}
+
+static const iwd_snapshot_device_t *snapshot_find_device(const char *device_name)
+{
+    if (s_map == NULL) {
+        return NULL;
+    }
+
+    const iwd_snapshot_device_t *devices = snapshot_devices();
+    for (uint32_t i = 0; i < snapshot_header()->device_count; i++) {
+        if (streq(devices[i].name, device_name)) {
+            return &devices[i];
+        }
+    }
+
+    return NULL;
+}
+
+void iwd_client_snapshot_seed_cache(void)
+{
+    if (s_map == NULL) {
+        return;
+    }
+
+    const iwd_snapshot_device_t *devices = snapshot_devices();
+    const iwd_network_record_t *networks = snapshot_networks();
+
+    for (uint32_t i = 0; i < snapshot_header()->device_count; i++) {
+        const iwd_snapshot_device_t *device = &devices[i];
+        if (!device->has_networks) {
+            continue;
+        }
+
+        struct l_queue *list = l_queue_new();
+        for (uint32_t n = device->first_network; n < device->first_network + device->network_count; n++) {
+            const iwd_network_record_t *record = &networks[n];
+            l_queue_push_tail(list, iwd_network_create(record->name, iwd_security_to_string(record->security),
+                                                       record->rssi100, record->connected, record->hidden,
+                                                       snapshot_string(record->path_offset),
+                                                       record->known_path_offset ?
+                                                           snapshot_string(record->known_path_offset) : NULL));
+        }
+
+        iwd_client_ordered_networks_cache_seed(device->name, list);
+    }
+}
+
+const char *iwd_client_snapshot_connected_ssid(const char *device_name)
+{
+    const iwd_snapshot_device_t *device = snapshot_find_device(device_name);
+    if (device == NULL || device->connected_ssid[0] == '\0') {
+        return NULL;
+    }
+
+    return device->connected_ssid;
+}
+
+struct l_queue *iwd_client_snapshot_known_networks(void)
+{
+    if (s_map == NULL) {
+        return NULL;
+    }
+
+    struct l_queue *list = l_queue_new();
+
+    const iwd_snapshot_known_t *known = snapshot_known();
+    for (uint32_t i = 0; i < snapshot_header()->known_count; i++) {
+        l_queue_push_tail(list, iwd_known_network_create(known[i].name, iwd_security_to_string(known[i].security),
+                                                         known[i].hidden, snapshot_string(known[i].path_offset)));
+    }
+
+    return list;
+}
+
+//
+// Comparing
+//
+
+// Sections of a snapshot in memory, the last one or one being saved
+typedef struct {
+    const iwd_snapshot_header_t *header;
+    const iwd_snapshot_device_t *devices;
+    const iwd_network_record_t *networks;
+    const iwd_snapshot_known_t *known;
+    const char *strings;
+} snapshot_view_t;
+
+static void snapshot_view(const uint8_t *data, snapshot_view_t *view)
+{
+    view->header = (const iwd_snapshot_header_t *)data;
+    view->devices = (const iwd_snapshot_device_t *)(view->header + 1);
+    view->networks = (const iwd_network_record_t *)(view->devices + view->header->device_count);
+    view->known = (const iwd_snapshot_known_t *)(view->networks + view->header->network_count);
+    view->strings = (const char *)(view->known + view->header->known_count);
+}
+
+// Same network, whatever its signal
+static bool snapshot_network_equal(const snapshot_view_t *a, const iwd_network_record_t *record_a,
+                                   const snapshot_view_t *b, const iwd_network_record_t *record_b)
+{
+    return streq(record_a->name, record_b->name) &&
+           record_a->security == record_b->security &&
+           record_a->connected == record_b->connected &&
+           record_a->hidden == record_b->hidden &&
+           streq(a->strings + record_a->path_offset, b->strings + record_b->path_offset) &&
+           streq(a->strings + record_a->known_path_offset, b->strings + record_b->known_path_offset);
+}
+
+// Same networks on the devices, in any order
+static bool snapshot_device_networks_equal(const snapshot_view_t *a, const iwd_snapshot_device_t *device_a,
+                                           const snapshot_view_t *b, const iwd_snapshot_device_t *device_b)
+{
+    if (device_a->network_count != device_b->network_count) {
+        return false;
+    }
+
+    for (uint32_t n = device_a->first_network; n < device_a->first_network + device_a->network_count; n++) {
+        bool found = false;
+        for (uint32_t m = device_b->first_network; m < device_b->first_network + device_b->network_count; m++) {
+            if (snapshot_network_equal(a, &a->networks[n], b, &b->networks[m])) {
+                found = true;
+                break;
+            }
+        }
+        if (!found) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// True if data only differs from the last snapshot in the signal and order of the networks
+static bool snapshot_same_but_signal(const uint8_t *data)
+{
+    if (s_map == NULL) {
+        return false;
+    }
+
+    snapshot_view_t last;
+    snapshot_view_t next;
+    snapshot_view(s_map, &last);
+    snapshot_view(data, &next);
+
+    if (last.header->device_count != next.header->device_count ||
+        last.header->network_count != next.header->network_count ||
+        last.header->known_count != next.header->known_count) {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < next.header->device_count; i++) {
+        const iwd_snapshot_device_t *device_last = &last.devices[i];
+        const iwd_snapshot_device_t *device_next = &next.devices[i];
+        if (!streq(device_last->name, device_next->name) ||
+            !streq(device_last->connected_ssid, device_next->connected_ssid) ||
+            device_last->has_networks != device_next->has_networks ||
+            !snapshot_device_networks_equal(&next, device_next, &last, device_last)) {
+            return false;
+        }
+    }
+
+    for (uint32_t i = 0; i < next.header->known_count; i++) {
+        const iwd_snapshot_known_t *known_last = &last.known[i];
+        const iwd_snapshot_known_t *known_next = &next.known[i];
+        if (!streq(known_last->name, known_next->name) ||
+            known_last->security != known_next->security ||
+            known_last->hidden != known_next->hidden ||
+            !streq(last.strings + known_last->path_offset, next.strings + known_next->path_offset)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+//
+// Saving
+//
+
+// Used twice. First without data to get the sizes, then to fill in data.
+typedef struct {
+    uint8_t *data; // NULL when sizing
+    iwd_snapshot_device_t *devices;
+    iwd_network_record_t *networks;
+    iwd_snapshot_known_t *known;
+    char *strings;
+
+    uint32_t device_count;
+    uint32_t network_count;
+    uint32_t known_count;
+    uint32_t strings_size;
+} snapshot_builder_t;
+
+static uint32_t builder_add_string(snapshot_builder_t *builder, const char *str)
+{
+    if (str == NULL) {
+        return 0;
+    }
+
+    uint32_t offset = builder->strings_size;
+    size_t size = strlen(str) + 1;
+
+    if (builder->data) {
+        memcpy(builder->strings + offset, str, size);
+    }
+    builder->strings_size += size;
+    return offset;
+}
+
+// record with its strings, which are added to those of the builder
+static void builder_add_network(snapshot_builder_t *builder, const iwd_network_record_t *record,
+                                const char *path, const char *known_path)
+{
+    uint32_t path_offset = builder_add_string(builder, path);
+    uint32_t known_path_offset = builder_add_string(builder, known_path);
+
+    if (builder->data) {
+        iwd_network_record_t *copy = &builder->networks[builder->network_count];
+        *copy = *record;
+        copy->path_offset = path_offset;
+        copy->known_path_offset = known_path_offset;
+    }
+    builder->network_count++;
+}
+
+static void builder_add_station(struct l_dbus_proxy *proxy, const iwd_proxy_props_t *props, void *user_data)
+{
+    snapshot_builder_t *builder = user_data;
+
+    const char *device_name = iwd_proxies_get_device_name_for_station(proxy);
+    if (device_name == NULL) {
+        return;
+    }
+
+    // No networks since the device or iwd came back. What was saved for the device is kept until there are.
+    struct l_queue *networks = iwd_client_ordered_networks_cached(device_name, NULL);
+    const iwd_snapshot_device_t *previous = networks ? NULL : snapshot_find_device(device_name);
+    if (previous && !previous->has_networks) {
+        previous = NULL;
+    }
+
+    if (builder->data) {
+        iwd_snapshot_device_t *device = &builder->devices[builder->device_count];
+        l_strlcpy(device->name, device_name, sizeof(device->name));
+
+        const iwd_proxy_props_t *connected_props = props->connected_path ?
+            iwd_proxies_get_props_by_path(IWD_PROXY_NETWORK, props->connected_path) : NULL;
+        if (connected_props && connected_props->name) {
+            l_strlcpy(device->connected_ssid, connected_props->name, sizeof(device->connected_ssid));
+        }
+
+        device->has_networks = networks != NULL || previous != NULL;
+        device->first_network = builder->network_count;
+        device->network_count = previous ? previous->network_count : l_queue_length(networks);
+    }
+    builder->device_count++;
+
+    for (const struct l_queue_entry *entry = l_queue_get_entries(networks); entry; entry = entry->next) {
+        const iwd_network_t *network = entry->data;
+
+        iwd_network_record_t record = { 0 };
+        l_strlcpy(record.name, network->name, sizeof(record.name));
+        record.security = iwd_security_from_string(network->type);
+        record.rssi100 = network->rssi100;
+        record.connected = network->connected;
+        record.hidden = network->hidden;
+        builder_add_network(builder, &record, network->path, network->known_path);
+    }
+
+    if (previous) {
+        const iwd_network_record_t *records = snapshot_networks();
+        for (uint32_t n = previous->first_network; n < previous->first_network + previous->network_count; n++) {
+            const iwd_network_record_t *record = &records[n];
+            builder_add_network(builder, record, snapshot_string(record->path_offset),
+                                record->known_path_offset ? snapshot_string(record->known_path_offset) : NULL);
+        }
+    }
+}
+
+static void builder_add_known_network(__attribute__((unused)) struct l_dbus_proxy *proxy,
+                                      const iwd_proxy_props_t *props, void *user_data)
+{
+    snapshot_builder_t *builder = user_data;
+
+    if (props->name == NULL) {
+        return;
+    }
+
+    uint32_t path_offset = builder_add_string(builder, props->path);
+
+    if (builder->data) {
+        iwd_snapshot_known_t *known = &builder->known[builder->known_count];
+        l_strlcpy(known->name, props->name, sizeof(known->name));
+        known->security = props->security;
+        known->hidden = props->hidden;
+        known->path_offset = path_offset;
+    }
+    builder->known_count++;
+}
+
+static void builder_run(snapshot_builder_t *builder)
+{
+    builder->device_count = 0;
+    builder->network_count = 0;
+    builder->known_count = 0;
+    builder->strings_size = 1; // Leading empty string
+
+    iwd_proxies_foreach_station(builder_add_station, builder);
+    iwd_proxies_foreach_known_network(builder_add_known_network, builder);
+}
+
+static bool snapshot_write(const char *path, const uint8_t *data, size_t size)
+{
+    char *tmp_path = l_strdup_printf("%s.tmp", path);
+
+    int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        l_error("iwd_client: Can't create snapshot '%s': %s", tmp_path, strerror(errno));
+        l_free(tmp_path);
+        return false;
+    }
+
+    size_t written = 0;
+    while (written < size) {
+        ssize_t ret = write(fd, data + written, size - written);
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ret <= 0) {
+            l_error("iwd_client: Can't write snapshot '%s': %s", tmp_path, strerror(errno));
+            close(fd);
+            unlink(tmp_path);
+            l_free(tmp_path);
+            return false;
+        }
+        written += ret;
+    }
+
+    // The content must be on disk before the rename makes it the snapshot
+    if (fsync(fd) < 0 || close(fd) < 0 || rename(tmp_path, path) < 0) {
+        l_error("iwd_client: Can't save snapshot '%s': %s", path, strerror(errno));
+        unlink(tmp_path);
+        l_free(tmp_path);
+        return false;
+    }
+
+    l_free(tmp_path);
+    return true;
+}
+
+static void snapshot_save(void)
+{
+    // Not while disconnected from iwd. There is nothing to save then, and the last good snapshot is kept.
+    if (!iwd_client_is_ready()) {
+        return;
+    }
+
+    snapshot_builder_t builder = { 0 };
+    builder_run(&builder); // Sizing
+
+    size_t size = sizeof(iwd_snapshot_header_t) +
+                  builder.device_count * sizeof(iwd_snapshot_device_t) +
+                  builder.network_count * sizeof(iwd_network_record_t) +
+                  builder.known_count * sizeof(iwd_snapshot_known_t) +
+                  builder.strings_size;
+
+    builder.data = l_new(uint8_t, size);
+    builder.devices = (iwd_snapshot_device_t *)(builder.data + sizeof(iwd_snapshot_header_t));
+    builder.networks = (iwd_network_record_t *)(builder.devices + builder.device_count);
+    builder.known = (iwd_snapshot_known_t *)(builder.networks + builder.network_count);
+    builder.strings = (char *)(builder.known + builder.known_count);
+    builder_run(&builder);
+
+    iwd_snapshot_header_t *header = (iwd_snapshot_header_t *)builder.data;
+    header->magic = IWD_SNAPSHOT_MAGIC;
+    header->version = IWD_SNAPSHOT_VERSION;
+    header->header_size = sizeof(iwd_snapshot_header_t);
+    header->size = size;
+    header->device_count = builder.device_count;
+    header->network_count = builder.network_count;
+    header->known_count = builder.known_count;
+    header->strings_size = builder.strings_size;
+    header->saved_time = time(NULL);
+
+    if (snapshot_same_but_signal(builder.data)) {
+        l_debug("iwd_client: Snapshot only has a new signal. Not saved");
+        l_free(builder.data);
+        return;
+    }
+
+    s_saved_usec = l_time_now(); // Also if the write fails, to not retry it right away
+    if (!snapshot_write(s_path, builder.data, size)) {
+        l_free(builder.data);
+        return;
+    }
+
+    l_debug("iwd_client: Saved snapshot '%s' (%zu bytes)", s_path, size);
+
+    // It is the last snapshot now
+    snapshot_release();
+    s_map = builder.data;
+    s_map_size = size;
+}
+
+static void snapshot_save_idle(struct l_idle *idle, __attribute__((unused)) void *user_data)
+{
+    l_idle_remove(idle);
+    s_save_idle = NULL;
+
+    snapshot_save();
+}
+
+static void snapshot_save_timeout(struct l_timeout *timeout, __attribute__((unused)) void *user_data)
+{
+    l_timeout_remove(timeout);
+    s_save_timeout = NULL;
+
+    snapshot_save();
+}
+
+void iwd_client_snapshot_changed(void)
+{
+    if (s_path == NULL || s_save_idle || s_save_timeout) {
+        return;
+    }
+
+    uint64_t since_ms = (l_time_now() - s_saved_usec) / 1000;
+    if (s_saved_usec && since_ms < SNAPSHOT_SAVE_INTERVAL_MS) {
+        s_save_timeout = l_timeout_create_ms(SNAPSHOT_SAVE_INTERVAL_MS - since_ms, snapshot_save_timeout,
+                                             NULL, NULL);
+        return;
+    }
+
+    s_save_idle = l_idle_create(snapshot_save_idle, NULL, NULL);
+}
+
+//
+// Open/Close
+//
+
+bool iwd_client_snapshot_open(const char *path)
+{
+    assert(path);
+
+    iwd_client_snapshot_close();
+
+    s_path = l_strdup(path);
+    return snapshot_load(path);
+}
+
+void iwd_client_snapshot_close(void)
+{
+    l_idle_remove(s_save_idle);
+    s_save_idle = NULL;
+    l_timeout_remove(s_save_timeout);
+    s_save_timeout = NULL;
+    s_saved_usec = 0;
+
+    snapshot_release();
+
+    l_free(s_path);
+    s_path = NULL;
+}
@@ -0,0 +1,141 @@
+//****************************************************************************
+//    Copyright (C) 2022 Orbital Systems AB.
+//    All rights reserved
+//****************************************************************************
+#include "iwd_client.h"
+
+#include "iwd_client_internal.h"
+#include "iwd_proxies.h"
+
+#include <assert.h>
+
+// Coalesced station events. Changes of a device are gathered from the first change and during the window,
+// and then delivered as one event with the values at that time. The window is not extended by later changes,
+// so an event is never delayed more than the window.
+
+typedef struct {
+    char *device_name;
+    uint32_t changed; // iwd_station_changed_t
+    struct l_timeout *timeout; // Window > 0
+    struct l_idle *idle; // Window == 0
+} station_events_pending_t;
+
+static iwd_client_station_event_cb_t s_station_event_cb; // NULL when not coalescing
+static uint32_t s_window_ms;
+
+static struct l_hashmap *s_pending; // device_name -> station_events_pending_t
+
+static void station_events_pending_destroy(void *data)
+{
+    station_events_pending_t *pending = data;
+
+    l_timeout_remove(pending->timeout);
+    l_idle_remove(pending->idle);
+    l_free(pending->device_name);
+    l_free(pending);
+}
+
+static void station_events_flush(station_events_pending_t *pending)
+{
+    l_hashmap_remove(s_pending, pending->device_name);
+
+    struct l_dbus_proxy *proxy_station = iwd_proxies_get_station_for_device(pending->device_name);
+    const iwd_proxy_props_t *props = proxy_station ? iwd_proxies_get_props(proxy_station) : NULL;
+    if (props == NULL) {
+        l_warn("iwd_client: Station for device='%s' is gone. Dropping its station event", pending->device_name);
+        station_events_pending_destroy(pending);
+        return;
+    }
+
+    const char *ssid = NULL;
+    if (props->connected_path) {
+        const iwd_proxy_props_t *connected_props = iwd_proxies_get_props_by_path(IWD_PROXY_NETWORK,
+                                                                                  props->connected_path);
+        ssid = connected_props ? connected_props->name : NULL;
+    }
+
+    iwd_station_event_t event = {
+        .device_name = pending->device_name,
+        .changed = pending->changed,
+        .scanning = props->scanning,
+        .state = props->state ? props->state : "unknown",
+        .connected_ssid = ssid,
+    };
+
+    l_debug("iwd_client: Station event on %s changed=0x%x scanning=%u state=%s ssid=%s", event.device_name,
+            event.changed, event.scanning, event.state, event.connected_ssid ? event.connected_ssid : "");
+
+    s_station_event_cb(&event);
+
+    station_events_pending_destroy(pending);
+}
+
+static void station_events_timeout(struct l_timeout *timeout, void *user_data)
+{
+    station_events_pending_t *pending = user_data;
+
+    l_timeout_remove(timeout);
+    pending->timeout = NULL;
+    station_events_flush(pending);
+}
+
+static void station_events_idle(struct l_idle *idle, void *user_data)
+{
+    station_events_pending_t *pending = user_data;
+
+    l_idle_remove(idle);
+    pending->idle = NULL;
+    station_events_flush(pending);
+}
+
+bool iwd_client_station_events_coalesced(void)
+{
+    return s_station_event_cb != NULL;
+}
+
+void iwd_client_station_events_changed(const char *device_name, iwd_station_changed_t changed)
+{
+    assert(s_station_event_cb);
+
+    station_events_pending_t *pending = l_hashmap_lookup(s_pending, device_name);
+    if (pending) {
+        pending->changed |= changed; // Delivered with the event already pending
+        return;
+    }
+
+    pending = l_new(station_events_pending_t, 1);
+    pending->device_name = l_strdup(device_name);
+    pending->changed = changed;
+
+    if (s_window_ms > 0) {
+        pending->timeout = l_timeout_create_ms(s_window_ms, station_events_timeout, pending, NULL);
+    }
+    else {
+        pending->idle = l_idle_create(station_events_idle, pending, NULL);
+    }
+
+    l_hashmap_insert(s_pending, device_name, pending);
+}
+
+void iwd_client_station_events_init(void)
+{
+    s_pending = l_hashmap_string_new();
+}
+
+void iwd_client_station_events_deinit(void)
+{
+    l_hashmap_destroy(s_pending, station_events_pending_destroy);
+    s_pending = NULL;
+}
+
+void iwd_client_set_station_event_cb(uint32_t window_ms, iwd_client_station_event_cb_t station_event_cb)
+{
+    s_window_ms = window_ms;
+    s_station_event_cb = station_event_cb;
+
+    if (station_event_cb == NULL && s_pending) {
+        // Back to direct callbacks. Changes still pending are dropped.
+        l_hashmap_destroy(s_pending, station_events_pending_destroy);
+        s_pending = l_hashmap_string_new();
+    }
+}
@@ -0,0 +1,216 @@
+//****************************************************************************
+//    Copyright (C) 2022 Orbital Systems AB.
+//    All rights reserved
+//****************************************************************************
+#include "iwd_client.h"
+
+#include "iwd_client_internal.h"
+#include "iwd_proxies.h"
+#include "iwd_util.h"
+
+#include <assert.h>
+
+// Scan on all stations at once and merge the ordered networks of all of them into one table.
+// Each station runs its own scan and get ordered networks, so the total time is that of the slowest.
+
+typedef struct {
+    iwd_client_survey_done_cb_t done_cb;
+    void *user_data;
+    uint32_t timeout_ms; // Of each device
+    struct l_queue *networks; // iwd_survey_network_t, unordered until done
+    struct l_hashmap *networks_by_key; // survey_key_t -> iwd_survey_network_t in networks
+    unsigned int pending; // Devices not yet done, +1 while starting
+    unsigned int succeeded;
+    iwd_status_t first_error;
+} survey_oper_t;
+
+typedef struct {
+    survey_oper_t *oper;
+    char *device_name;
+} survey_device_t;
+
+typedef struct {
+    const char *name; // Of the merged network in the hashmap, which outlives the key
+    iwd_security_t security;
+} survey_key_t;
+
+static unsigned int survey_key_hash(const void *p)
+{
+    const survey_key_t *key = p;
+    return l_str_hash(key->name) * 31 + key->security;
+}
+
+static int survey_key_compare(const void *a, const void *b)
+{
+    const survey_key_t *key_a = a;
+    const survey_key_t *key_b = b;
+
+    if (key_a->security != key_b->security) {
+        return key_a->security < key_b->security ? -1 : 1;
+    }
+    return strcmp(key_a->name, key_b->name);
+}
+
+static void *survey_key_copy(const void *p)
+{
+    return l_memdup(p, sizeof(survey_key_t));
+}
+
+static void survey_network_add_sighting(iwd_survey_network_t *network, const char *device_name, int16_t rssi100)
+{
+    if (network->sighting_count == IWD_SURVEY_MAX_DEVICES) {
+        l_warn("iwd_client: Survey has more than %u devices. Dropping sighting on %s",
+               IWD_SURVEY_MAX_DEVICES, device_name);
+        return;
+    }
+
+    // Keep the strongest first
+    unsigned int i = network->sighting_count++;
+    while (i > 0 && network->sightings[i - 1].rssi100 < rssi100) {
+        network->sightings[i] = network->sightings[i - 1];
+        i--;
+    }
+    l_strlcpy(network->sightings[i].device_name, device_name, sizeof(network->sightings[i].device_name));
+    network->sightings[i].rssi100 = rssi100;
+
+    network->rssi100 = network->sightings[0].rssi100;
+}
+
+static void survey_merge(survey_oper_t *oper, const char *device_name, struct l_queue *networks)
+{
+    for (const struct l_queue_entry *entry = l_queue_get_entries(networks); entry; entry = entry->next) {
+        const iwd_network_t *network = entry->data;
+
+        survey_key_t key = { .name = network->name, .security = iwd_security_from_string(network->type) };
+        iwd_survey_network_t *merged = l_hashmap_lookup(oper->networks_by_key, &key);
+        if (merged == NULL) {
+            merged = l_new(iwd_survey_network_t, 1);
+            merged->name = l_strdup(network->name);
+            merged->security = key.security;
+            l_queue_push_tail(oper->networks, merged);
+
+            key.name = merged->name;
+            l_hashmap_insert(oper->networks_by_key, &key, merged);
+        }
+
+        merged->connected |= network->connected;
+        merged->known |= network->known_path != NULL;
+        merged->hidden |= network->hidden;
+        survey_network_add_sighting(merged, device_name, network->rssi100);
+    }
+}
+
+static int survey_network_compare(const void *a, const void *b, __attribute__((unused)) void *user_data)
+{
+    const iwd_survey_network_t *network_a = a;
+    const iwd_survey_network_t *network_b = b;
+
+    return network_b->rssi100 - network_a->rssi100; // Strongest first
+}
+
+static void survey_oper_unpend(survey_oper_t *oper)
+{
+    assert(oper->pending > 0);
+    if (--oper->pending > 0) {
+        return;
+    }
+
+    // All devices are done
+    iwd_status_t status = oper->succeeded > 0 ? IWD_STATUS_SUCCESS : oper->first_error;
+
+    l_hashmap_destroy(oper->networks_by_key, NULL); // Before the networks, as the keys use their names
+
+    struct l_queue *networks = NULL;
+    if (status == IWD_STATUS_SUCCESS) {
+        networks = oper->networks;
+        l_queue_sort(networks, survey_network_compare, NULL); // Once, now that all are merged
+    }
+    else {
+        iwd_survey_network_list_destroy(oper->networks);
+    }
+
+    l_info("iwd_client: Survey done with status=%d. %u devices succeeded, %u networks",
+           status, oper->succeeded, l_queue_length(networks));
+
+    oper->done_cb(status, networks, oper->user_data);
+    l_free(oper);
+}
+
+static void survey_device_done(iwd_status_t status, struct l_queue *networks, void *user_data)
+{
+    survey_device_t *device = user_data;
+    survey_oper_t *oper = device->oper;
+
+    if (status == IWD_STATUS_SUCCESS) {
+        survey_merge(oper, device->device_name, networks);
+        oper->succeeded++;
+    }
+    else {
+        l_warn("iwd_client: Survey on %s failed with status=%d", device->device_name, status);
+        if (oper->first_error == IWD_STATUS_SUCCESS) {
+            oper->first_error = status;
+        }
+    }
+
+    iwd_network_list_destroy(networks);
+    l_free(device->device_name);
+    l_free(device);
+
+    survey_oper_unpend(oper);
+}
+
+static void survey_each_station(struct l_dbus_proxy *proxy, __attribute__((unused)) const iwd_proxy_props_t *props,
+                                void *user_data)
+{
+    survey_oper_t *oper = user_data;
+
+    const char *device_name = iwd_proxies_get_device_name_for_station(proxy);
+    if (device_name == NULL) {
+        return;
+    }
+
+    survey_device_t *device = l_new(survey_device_t, 1);
+    device->oper = oper;
+    device->device_name = l_strdup(device_name);
+
+    // Callback is always called, also on early errors
+    oper->pending++;
+    iwd_client_scan_ordered_networks_async(device_name, oper->timeout_ms, survey_device_done, device);
+}
+
+bool iwd_client_survey_async(uint32_t timeout_ms,
+                             iwd_client_survey_done_cb_t survey_done_cb,
+                             void *user_data)
+{
+    assert(survey_done_cb);
+    assert(timeout_ms > 0);
+
+    l_info("iwd_client: Survey on all stations");
+
+    survey_oper_t *oper = l_new(survey_oper_t, 1);
+    oper->done_cb = survey_done_cb;
+    oper->user_data = user_data;
+    oper->networks = l_queue_new();
+    oper->networks_by_key = l_hashmap_new();
+    l_hashmap_set_hash_function(oper->networks_by_key, survey_key_hash);
+    l_hashmap_set_compare_function(oper->networks_by_key, survey_key_compare);
+    l_hashmap_set_key_copy_function(oper->networks_by_key, survey_key_copy);
+    l_hashmap_set_key_free_function(oper->networks_by_key, l_free);
+    oper->first_error = IWD_STATUS_SUCCESS;
+    oper->timeout_ms = timeout_ms;
+
+    // Held while starting, so devices failing early can't complete the survey before all are started
+    oper->pending = 1;
+    iwd_proxies_foreach_station(survey_each_station, oper);
+
+    // No device finishes with success during the call, so the survey is started only if some are still pending.
+    // Otherwise it is done when unpended below, and the callback has run with the error.
+    bool started = oper->pending > 1;
+    if (oper->succeeded == 0 && oper->first_error == IWD_STATUS_SUCCESS && !started) {
+        l_error("iwd_client: No stations to survey");
+        oper->first_error = IWD_STATUS_STATION_NOT_FOUND;
+    }
+
+    survey_oper_unpend(oper);
+    return started;
+}
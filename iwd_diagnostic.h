@@ -0,0 +1,42 @@
+//****************************************************************************
+//    Copyright (C) 2022 Orbital Systems AB.
+//    All rights reserved
+//****************************************************************************
+#pragma once
+
+#include "iwd_network.h"
+
+#include <stdint.h>
+
+// Station diagnostics. Samples of StationDiagnostic.GetDiagnostics, decoded into fixed size records.
+
+typedef struct {
+    uint64_t time_usec; // l_time_now() when the reply came
+    char bss[18]; // ConnectedBss, "xx:xx:xx:xx:xx:xx"
+    char security_name[24]; // Security, as iwd gives it, eg. "WPA2-Personal"
+    iwd_security_t security; // Decoded from security_name
+    uint32_t frequency_mhz;
+    uint16_t channel;
+    int16_t rssi100; // 100 * dBm
+    int16_t average_rssi100; // 0 if not given
+    uint32_t rx_bitrate_kbps; // 0 if not given
+    uint32_t tx_bitrate_kbps; // 0 if not given
+    uint32_t inactive_ms;
+} iwd_diagnostic_sample_t;
+
+typedef struct {
+    int32_t min;
+    int32_t avg;
+    int32_t max;
+} iwd_diagnostic_range_t;
+
+// Over the samples of a window. Bitrates that are not given (0) are left out of their range.
+typedef struct {
+    uint32_t count; // Samples in the window. Ranges are all 0 if none.
+    uint64_t first_usec;
+    uint64_t last_usec;
+    iwd_diagnostic_range_t rssi100;
+    iwd_diagnostic_range_t rx_bitrate_kbps;
+    iwd_diagnostic_range_t tx_bitrate_kbps;
+    iwd_diagnostic_range_t frequency_mhz;
+} iwd_diagnostic_summary_t;
@@ -6,6 +6,44 @@
 
 #include "iwd_util.h"
 
+#include <assert.h>
+
+//
+// security
+//
+
+static const char * const security_table[] = {
+    [IWD_SECURITY_UNKNOWN] = "unknown",
+    [IWD_SECURITY_OPEN] = "open",
+    [IWD_SECURITY_WEP] = "wep",
+    [IWD_SECURITY_PSK] = "psk",
+    [IWD_SECURITY_8021X] = "8021x",
+    [IWD_SECURITY_HOTSPOT] = "hotspot",
+};
+
+iwd_security_t iwd_security_from_string(const char *type)
+{
+    if (type == NULL) {
+        return IWD_SECURITY_UNKNOWN;
+    }
+
+    for (iwd_security_t security = IWD_SECURITY_OPEN; security <= IWD_SECURITY_HOTSPOT; security++) {
+        if (streq(type, security_table[security])) {
+            return security;
+        }
+    }
+
+    return IWD_SECURITY_UNKNOWN;
+}
+
+const char *iwd_security_to_string(iwd_security_t security)
+{
+    if (security > IWD_SECURITY_HOTSPOT) {
+        return security_table[IWD_SECURITY_UNKNOWN];
+    }
+    return security_table[security];
+}
+
 //
 // network
 //
@@ -39,6 +77,13 @@ void iwd_network_destroy(iwd_network_t *network)
     l_free(network);
 }
 
+iwd_network_t *iwd_network_copy(const iwd_network_t *network)
+{
+    return iwd_network_create(network->name, network->type, network->rssi100,
+                              network->connected, network->hidden,
+                              network->path, network->known_path);
+}
+
 static void iwd_network_destroy_void(void *data)
 {
     iwd_network_destroy(data);
@@ -49,6 +94,135 @@ void iwd_network_list_destroy(struct l_queue *list)
     l_queue_destroy(list, iwd_network_destroy_void);
 }
 
+struct l_queue *iwd_network_list_copy(struct l_queue *list)
+{
+    struct l_queue *copy = l_queue_new();
+
+    for (const struct l_queue_entry *entry = l_queue_get_entries(list); entry; entry = entry->next) {
+        l_queue_push_tail(copy, iwd_network_copy(entry->data));
+    }
+
+    return copy;
+}
+
+iwd_network_t *iwd_network_from_view(const iwd_network_view_t *view)
+{
+    return iwd_network_create(view->name, iwd_security_to_string(view->security), view->rssi100,
+                              view->connected, view->hidden,
+                              view->path, view->known_path);
+}
+
+struct l_queue *iwd_network_list_from_views(const iwd_network_view_t *views, size_t count)
+{
+    struct l_queue *list = l_queue_new();
+
+    for (size_t i = 0; i < count; i++) {
+        l_queue_push_tail(list, iwd_network_from_view(&views[i]));
+    }
+
+    return list;
+}
+
+//
+// survey
+//
+
+void iwd_survey_network_destroy(iwd_survey_network_t *network)
+{
+    l_free(network->name);
+    l_free(network);
+}
+
+static void iwd_survey_network_destroy_void(void *data)
+{
+    iwd_survey_network_destroy(data);
+}
+
+void iwd_survey_network_list_destroy(struct l_queue *list)
+{
+    l_queue_destroy(list, iwd_survey_network_destroy_void);
+}
+
+//
+// packed
+//
+
+// While adding, strings are placed after the space of max_count records. Moved down by iwd_network_packed_finish().
+static char *iwd_network_packed_strings(iwd_network_packed_t *packed, uint32_t max_count)
+{
+    return (char *)&packed->records[max_count];
+}
+
+iwd_network_packed_t *iwd_network_packed_new(uint32_t max_count, uint32_t strings_size)
+{
+    iwd_network_packed_t *packed = l_malloc(sizeof(iwd_network_packed_t) +
+                                            max_count * sizeof(iwd_network_record_t) +
+                                            strings_size);
+    packed->count = 0;
+    packed->strings_size = 1;
+    iwd_network_packed_strings(packed, max_count)[0] = '\0';
+    return packed;
+}
+
+static uint32_t iwd_network_packed_add_string(iwd_network_packed_t *packed, uint32_t max_count, const char *str)
+{
+    uint32_t offset = packed->strings_size;
+    size_t size = strlen(str) + 1;
+
+    memcpy(iwd_network_packed_strings(packed, max_count) + offset, str, size);
+    packed->strings_size += size;
+    return offset;
+}
+
+void iwd_network_packed_add(iwd_network_packed_t *packed, uint32_t max_count,
+                            const char *name, iwd_security_t security, int16_t rssi100,
+                            bool connected, bool hidden,
+                            const char *path,
+                            const char *known_path) // Can be NULL
+{
+    assert(packed->count < max_count);
+
+    iwd_network_record_t *record = &packed->records[packed->count++];
+
+    l_strlcpy(record->name, name, sizeof(record->name));
+    record->security = security;
+    record->rssi100 = rssi100;
+    record->connected = connected;
+    record->hidden = hidden;
+    record->path_offset = iwd_network_packed_add_string(packed, max_count, path);
+    record->known_path_offset = known_path ? iwd_network_packed_add_string(packed, max_count, known_path) : 0;
+}
+
+iwd_network_packed_t *iwd_network_packed_finish(iwd_network_packed_t *packed, uint32_t max_count)
+{
+    if (packed->count < max_count) {
+        // Move the strings down to directly after the last record, and give back the space left
+        memmove(&packed->records[packed->count], iwd_network_packed_strings(packed, max_count), packed->strings_size);
+        packed = l_realloc(packed, sizeof(iwd_network_packed_t) +
+                                   packed->count * sizeof(iwd_network_record_t) +
+                                   packed->strings_size);
+    }
+    return packed;
+}
+
+void iwd_network_packed_destroy(iwd_network_packed_t *packed)
+{
+    l_free(packed);
+}
+
+const char *iwd_network_packed_path(const iwd_network_packed_t *packed, const iwd_network_record_t *record)
+{
+    return (const char *)&packed->records[packed->count] + record->path_offset;
+}
+
+const char *iwd_network_packed_known_path(const iwd_network_packed_t *packed, const iwd_network_record_t *record)
+{
+    if (record->known_path_offset == 0) {
+        return NULL;
+    }
+    return (const char *)&packed->records[packed->count] + record->known_path_offset;
+}
+
 static bool iwd_network_match_by_known_path(const void *a, const void *b)
 {
     const iwd_network_t *network = a;
@@ -7,8 +7,22 @@
 #include <ell/ell.h>
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
+// Type of Network and KnownNetwork
+typedef enum {
+    IWD_SECURITY_UNKNOWN = 0,
+    IWD_SECURITY_OPEN,
+    IWD_SECURITY_WEP,
+    IWD_SECURITY_PSK,
+    IWD_SECURITY_8021X,
+    IWD_SECURITY_HOTSPOT, // Only on KnownNetwork
+} iwd_security_t;
+
+iwd_security_t iwd_security_from_string(const char *type); // type can be NULL
+const char *iwd_security_to_string(iwd_security_t security);
+
 typedef struct {
     char *name;
     char *type;
@@ -25,8 +39,99 @@ iwd_network_t *iwd_network_create(const char *name, const char *type, int16_t rs
                                   const char *path,
                                   const char *known_path); // Can be NULL
 void iwd_network_destroy(iwd_network_t *network);
+iwd_network_t *iwd_network_copy(const iwd_network_t *network);
 
 void iwd_network_list_destroy(struct l_queue *list);
+struct l_queue *iwd_network_list_copy(struct l_queue *list);
+
+// Read-only view of a network. Strings are borrowed and only valid as long as told by the one handing it out.
+typedef struct {
+    const char *name;
+    iwd_security_t security;
+    int16_t rssi100; // Same as in iwd_network_t
+    bool connected;
+    bool hidden;
+    const char *path;
+    const char *known_path; // NULL if not a known network
+} iwd_network_view_t;
+
+iwd_network_t *iwd_network_from_view(const iwd_network_view_t *view);
+struct l_queue *iwd_network_list_from_views(const iwd_network_view_t *views, size_t count);
+
+// A network seen by one or more devices, merged by SSID and security
+#define IWD_SURVEY_MAX_DEVICES 4
+
+typedef struct {
+    char device_name[16]; // IFNAMSIZ
+    int16_t rssi100; // Same as in iwd_network_t
+} iwd_survey_sighting_t;
+
+typedef struct {
+    char *name;
+    iwd_security_t security;
+    int16_t rssi100; // Best of the sightings
+    bool connected; // On any device
+    bool known;
+    bool hidden;
+    unsigned int sighting_count;
+    iwd_survey_sighting_t sightings[IWD_SURVEY_MAX_DEVICES]; // Strongest first
+} iwd_survey_network_t;
+
+void iwd_survey_network_destroy(iwd_survey_network_t *network);
+void iwd_survey_network_list_destroy(struct l_queue *list);
+
+// Change of a network between two ordered networks results
+typedef enum {
+    IWD_NETWORK_DELTA_ADDED,
+    IWD_NETWORK_DELTA_REMOVED,
+    IWD_NETWORK_DELTA_CHANGED, // RSSI moved beyond the threshold, or connected flipped
+} iwd_network_delta_kind_t;
+
+typedef struct {
+    iwd_network_delta_kind_t kind;
+    const char *name;
+    const char *path; // Network path, which is unique per SSID and security on a device
+    int16_t rssi100; // Now. Last reported for IWD_NETWORK_DELTA_REMOVED.
+    int16_t old_rssi100; // Last reported. Same as rssi100 if not IWD_NETWORK_DELTA_CHANGED.
+    bool connected;
+} iwd_network_delta_t;
+
+// Packed networks. One allocation holding an array of fixed size records followed by the path strings.
+// Freed with one call and iterated without following pointers. Contains no pointers, so it can be copied as is.
+#define IWD_SSID_MAX_LEN 32
+
+typedef struct {
+    char name[IWD_SSID_MAX_LEN + 1];
+    iwd_security_t security;
+    int16_t rssi100; // Same as in iwd_network_t
+    bool connected;
+    bool hidden;
+    uint32_t path_offset; // Into the strings, see iwd_network_packed_path()
+    uint32_t known_path_offset; // 0 if not a known network
+} iwd_network_record_t;
+
+typedef struct {
+    uint32_t count;
+    uint32_t strings_size; // Bytes of strings after records[count]. Offset 0 is an empty string.
+    iwd_network_record_t records[];
+} iwd_network_packed_t;
+
+// Built with new, add for each network, and finish.
+// Allocates room for max_count records and strings_size bytes of strings, including the leading empty string.
+iwd_network_packed_t *iwd_network_packed_new(uint32_t max_count, uint32_t strings_size);
+// Adds a record at the end. There must be room left from iwd_network_packed_new().
+void iwd_network_packed_add(iwd_network_packed_t *packed, uint32_t max_count,
+                            const char *name, iwd_security_t security, int16_t rssi100,
+                            bool connected, bool hidden,
+                            const char *path,
+                            const char *known_path); // Can be NULL
+// Must be called when all records are added. Returns the packed networks, which may have been moved.
+iwd_network_packed_t *iwd_network_packed_finish(iwd_network_packed_t *packed, uint32_t max_count);
+void iwd_network_packed_destroy(iwd_network_packed_t *packed);
+
+const char *iwd_network_packed_path(const iwd_network_packed_t *packed, const iwd_network_record_t *record);
+// NULL if not a known network
+const char *iwd_network_packed_known_path(const iwd_network_packed_t *packed, const iwd_network_record_t *record);
 
 typedef struct {
     char *name;
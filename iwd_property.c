@@ -0,0 +1,50 @@
+//****************************************************************************
+//    Copyright (C) 2022 Orbital Systems AB.
+//    All rights reserved
+//****************************************************************************
+#include "iwd_property.h"
+
+#include <stddef.h>
+#include <string.h>
+
+// Perfect hash over the property names below. Only one candidate needs to be compared per lookup.
+// If a property is added, the hash must be checked (and maybe tweaked) to still be collision free.
+#define PROPERTY_HASH(len, first, last) (((len) * 3 + (first) + (last) * 5) & 15)
+
+typedef struct {
+    const char *name;
+    size_t len;
+    iwd_property_t property;
+} property_entry_t;
+
+// First and last character must be given separately as indexing a string literal is not a constant expression
+#define PROPERTY_ENTRY(str, first, last, prop) \
+    [PROPERTY_HASH(sizeof(str) - 1, first, last)] = { str, sizeof(str) - 1, prop }
+
+static const property_entry_t property_table[16] = {
+    PROPERTY_ENTRY("Name", 'N', 'e', IWD_PROPERTY_NAME),
+    PROPERTY_ENTRY("Type", 'T', 'e', IWD_PROPERTY_TYPE),
+    PROPERTY_ENTRY("Hidden", 'H', 'n', IWD_PROPERTY_HIDDEN),
+    PROPERTY_ENTRY("Connected", 'C', 'd', IWD_PROPERTY_CONNECTED),
+    PROPERTY_ENTRY("Device", 'D', 'e', IWD_PROPERTY_DEVICE),
+    PROPERTY_ENTRY("KnownNetwork", 'K', 'k', IWD_PROPERTY_KNOWN_NETWORK),
+    PROPERTY_ENTRY("Scanning", 'S', 'g', IWD_PROPERTY_SCANNING),
+    PROPERTY_ENTRY("State", 'S', 'e', IWD_PROPERTY_STATE),
+    PROPERTY_ENTRY("ConnectedNetwork", 'C', 'k', IWD_PROPERTY_CONNECTED_NETWORK),
+};
+
+iwd_property_t iwd_property_lookup(const char *name)
+{
+    size_t len = strlen(name);
+    if (len == 0) {
+        return IWD_PROPERTY_UNKNOWN;
+    }
+
+    const property_entry_t *entry = &property_table[PROPERTY_HASH(len, (unsigned char)name[0],
+                                                                  (unsigned char)name[len - 1])];
+    if (entry->len != len || memcmp(entry->name, name, len) != 0) {
+        return IWD_PROPERTY_UNKNOWN;
+    }
+
+    return entry->property;
+}
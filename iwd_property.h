@@ -0,0 +1,22 @@
+//****************************************************************************
+//    Copyright (C) 2022 Orbital Systems AB.
+//    All rights reserved
+//****************************************************************************
+#pragma once
+
+// iwd DBUS properties we care about, over all interfaces
+typedef enum {
+    IWD_PROPERTY_UNKNOWN = 0,
+
+    IWD_PROPERTY_NAME, // Device, Network, KnownNetwork
+    IWD_PROPERTY_TYPE, // Network, KnownNetwork
+    IWD_PROPERTY_HIDDEN, // KnownNetwork
+    IWD_PROPERTY_CONNECTED, // Network
+    IWD_PROPERTY_DEVICE, // Network
+    IWD_PROPERTY_KNOWN_NETWORK, // Network
+    IWD_PROPERTY_SCANNING, // Station
+    IWD_PROPERTY_STATE, // Station
+    IWD_PROPERTY_CONNECTED_NETWORK, // Station
+} iwd_property_t;
+
+iwd_property_t iwd_property_lookup(const char *name);
@@ -6,204 +6,621 @@
 
 #include "iwd_util.h"
 
-static struct l_queue *s_iwd_proxies_list = NULL;
+// One entry per tracked proxy.
+// The cached properties are also what the proxy is indexed under in the secondary indexes. The proxy itself
+// already has the new value when we get to know about a change, so the old key is taken from here.
+typedef struct proxy_entry {
+    struct l_dbus_proxy *proxy;
+    iwd_proxy_props_t props; // props.kind is tagged once when added
+    bool indexed;
+    struct proxy_entry *next_same; // Next entry indexed under the same key. Eg. same SSID but other Type
+} proxy_entry_t;
+
+static const char * const interface_table[IWD_PROXY_KIND_COUNT] = {
+    [IWD_PROXY_DEVICE] = "net.connman.iwd.Device",
+    [IWD_PROXY_STATION] = "net.connman.iwd.Station",
+    [IWD_PROXY_NETWORK] = "net.connman.iwd.Network",
+    [IWD_PROXY_KNOWN_NETWORK] = "net.connman.iwd.KnownNetwork",
+    [IWD_PROXY_AGENT_MANAGER] = "net.connman.iwd.AgentManager",
+    [IWD_PROXY_STATION_DIAGNOSTIC] = "net.connman.iwd.StationDiagnostic",
+};
+
+static struct l_hashmap *s_entry_by_proxy = NULL; // proxy -> proxy_entry_t. Holds all proxies, also IWD_PROXY_OTHER
+
+// Only one object of each kind (except IWD_PROXY_OTHER) can exist on a path
+static struct l_hashmap *s_entry_by_path[IWD_PROXY_KIND_COUNT]; // path -> proxy_entry_t
+static struct l_queue *s_entry_list[IWD_PROXY_KIND_COUNT]; // proxy_entry_t in the order added
+static uint32_t s_generation[IWD_PROXY_KIND_COUNT]; // Bumped on every add, remove and property change of a kind
+
+// Secondary indexes
+static struct l_hashmap *s_device_by_name = NULL; // Name -> Device proxy_entry_t
+static struct l_hashmap *s_network_by_ssid = NULL; // (Device path, Name) -> Network proxy_entry_t
+static struct l_hashmap *s_knownnetwork_by_ssid = NULL; // Name -> KnownNetwork proxy_entry_t
+
+//
+// Proxy access
+// Everything the registry needs from a proxy goes through s_ops. Defaults to ell.
+//
+
+static const char *ell_get_interface(struct l_dbus_proxy *proxy)
+{
+    return l_dbus_proxy_get_interface(proxy);
+}
 
-void iwd_proxies_init(void)
+static const char *ell_get_path(struct l_dbus_proxy *proxy)
 {
-    s_iwd_proxies_list = l_queue_new();
+    return l_dbus_proxy_get_path(proxy);
 }
 
-void iwd_proxies_deinit(void)
+static bool ell_get_string(struct l_dbus_proxy *proxy, const char *name, const char *signature, const char **value)
 {
-    l_queue_destroy(s_iwd_proxies_list, NULL);
+    return l_dbus_proxy_get_property(proxy, name, signature, value);
 }
 
-void iwd_proxies_add(struct l_dbus_proxy *proxy)
+static bool ell_get_bool(struct l_dbus_proxy *proxy, const char *name, bool *value)
 {
-    l_queue_push_tail(s_iwd_proxies_list, proxy);
+    return l_dbus_proxy_get_property(proxy, name, "b", value);
 }
 
-void iwd_proxies_remove(struct l_dbus_proxy *proxy)
+static const iwd_proxies_ops_t ell_ops = {
+    .get_interface = ell_get_interface,
+    .get_path = ell_get_path,
+    .get_string = ell_get_string,
+    .get_bool = ell_get_bool,
+};
+
+static const iwd_proxies_ops_t *s_ops = &ell_ops;
+
+void iwd_proxies_set_ops(const iwd_proxies_ops_t *ops)
 {
-    l_queue_remove(s_iwd_proxies_list, proxy);
+    s_ops = ops ? ops : &ell_ops;
 }
 
-void iwd_proxies_clear(void)
+static iwd_proxy_kind_t interface_to_kind(const char *interface)
+{
+    for (iwd_proxy_kind_t kind = IWD_PROXY_DEVICE; kind < IWD_PROXY_KIND_COUNT; kind++) {
+        if (streq(interface, interface_table[kind])) {
+            return kind;
+        }
+    }
+
+    return IWD_PROXY_OTHER;
+}
+
+// Key of two strings, (device path, ssid)
+typedef struct {
+    const char *first;
+    const char *second;
+} pair_key_t;
+
+static unsigned int pair_key_hash(const void *p)
 {
-    l_queue_clear(s_iwd_proxies_list, NULL);
+    const pair_key_t *key = p;
+    return l_str_hash(key->first) * 31 + l_str_hash(key->second);
 }
 
-static struct l_dbus_proxy *iwd_proxies_find(const char *interface, const char *path)
+static int pair_key_compare(const void *a, const void *b)
 {
-    for (const struct l_queue_entry *entry = l_queue_get_entries(s_iwd_proxies_list); entry; entry = entry->next) {
-        struct l_dbus_proxy *proxy = entry->data;
+    const pair_key_t *key_a = a;
+    const pair_key_t *key_b = b;
 
-        if (streq(interface, l_dbus_proxy_get_interface(proxy)) && streq(path, l_dbus_proxy_get_path(proxy))) {
-            return proxy;
-        }
+    int cmp = strcmp(key_a->first, key_b->first);
+    if (cmp != 0) {
+        return cmp;
     }
+    return strcmp(key_a->second, key_b->second);
+}
 
-    return NULL;
+// The head of an index chain can change, so the key needs its own strings.
+// Key and strings are put in the same allocation so it can be freed with l_free().
+static void *pair_key_copy(const void *p)
+{
+    const pair_key_t *src = p;
+    size_t first_len = strlen(src->first) + 1;
+    size_t second_len = strlen(src->second) + 1;
+
+    pair_key_t *key = l_malloc(sizeof(pair_key_t) + first_len + second_len);
+    char *strings = (char *)(key + 1);
+    memcpy(strings, src->first, first_len);
+    memcpy(strings + first_len, src->second, second_len);
+    key->first = strings;
+    key->second = strings + first_len;
+
+    return key;
 }
 
-struct l_dbus_proxy *iwd_proxies_get_device_by_name(const char *device_name)
+static struct l_hashmap *pair_key_hashmap_new(void)
 {
-    for (const struct l_queue_entry *entry = l_queue_get_entries(s_iwd_proxies_list); entry; entry = entry->next) {
-        struct l_dbus_proxy *proxy = entry->data;
+    struct l_hashmap *map = l_hashmap_new();
+    l_hashmap_set_hash_function(map, pair_key_hash);
+    l_hashmap_set_compare_function(map, pair_key_compare);
+    l_hashmap_set_key_copy_function(map, pair_key_copy);
+    l_hashmap_set_key_free_function(map, l_free);
+    return map;
+}
 
-        const char *interface = l_dbus_proxy_get_interface(proxy);
-        if (!streq(interface, "net.connman.iwd.Device")) {
-            continue;
-        }
+static bool hashmap_remove_all(__attribute__((unused)) const void *key,
+                               __attribute__((unused)) void *value,
+                               __attribute__((unused)) void *user_data)
+{
+    return true;
+}
 
-        const char *name;
-        if (!l_dbus_proxy_get_property(proxy, "Name", "s", &name)) {
-            continue;
+//
+// Secondary indexes
+// More than one proxy can have the same key (same SSID but different Type). They are chained through
+// next_same, and the first one added is the one found.
+//
+
+static void index_add(struct l_hashmap *index, const void *key, proxy_entry_t *entry)
+{
+    proxy_entry_t *head = l_hashmap_lookup(index, key);
+    if (head == NULL) {
+        l_hashmap_insert(index, key, entry);
+        return;
+    }
+
+    while (head->next_same) {
+        head = head->next_same;
+    }
+    head->next_same = entry;
+}
+
+static void index_remove(struct l_hashmap *index, const void *key, proxy_entry_t *entry)
+{
+    proxy_entry_t *head = l_hashmap_lookup(index, key);
+    if (head == entry) {
+        l_hashmap_remove(index, key);
+        if (entry->next_same) {
+            l_hashmap_insert(index, key, entry->next_same);
+        }
+    }
+    else {
+        for (; head; head = head->next_same) {
+            if (head->next_same == entry) {
+                head->next_same = entry->next_same;
+                break;
+            }
         }
+    }
 
-        if (streq(device_name, name)) {
-            return proxy; // Found
+    entry->next_same = NULL;
+}
+
+static void proxy_entry_index(proxy_entry_t *entry)
+{
+    iwd_proxy_props_t *props = &entry->props;
+
+    if (props->name == NULL) {
+        return;
+    }
+
+    switch (props->kind) {
+    case IWD_PROXY_DEVICE:
+        index_add(s_device_by_name, props->name, entry);
+        entry->indexed = true;
+        break;
+
+    case IWD_PROXY_NETWORK: {
+        if (props->device_path == NULL) {
+            return;
         }
+        pair_key_t key = { .first = props->device_path, .second = props->name };
+        index_add(s_network_by_ssid, &key, entry);
+        entry->indexed = true;
+        break;
     }
 
-    return NULL;
+    case IWD_PROXY_KNOWN_NETWORK:
+        index_add(s_knownnetwork_by_ssid, props->name, entry);
+        entry->indexed = true;
+        break;
+
+    default:
+        break;
+    }
 }
 
-struct l_dbus_proxy *iwd_proxies_get_device_by_path(const char *path)
+static void proxy_entry_unindex(proxy_entry_t *entry)
 {
-    return iwd_proxies_find("net.connman.iwd.Device", path);
+    iwd_proxy_props_t *props = &entry->props;
+
+    if (!entry->indexed) {
+        return;
+    }
+
+    switch (props->kind) {
+    case IWD_PROXY_DEVICE:
+        index_remove(s_device_by_name, props->name, entry);
+        break;
+
+    case IWD_PROXY_NETWORK: {
+        pair_key_t key = { .first = props->device_path, .second = props->name };
+        index_remove(s_network_by_ssid, &key, entry);
+        break;
+    }
+
+    case IWD_PROXY_KNOWN_NETWORK:
+        index_remove(s_knownnetwork_by_ssid, props->name, entry);
+        break;
+
+    default:
+        break;
+    }
+
+    entry->indexed = false;
 }
 
-struct l_dbus_proxy *iwd_proxies_get_agent_manager(void)
+//
+// Property cache
+//
+
+static void load_string(struct l_dbus_proxy *proxy, const char *name, const char *signature, char **field)
 {
-    return iwd_proxies_find("net.connman.iwd.AgentManager", "/net/connman/iwd");
+    const char *value = NULL;
+    if (!s_ops->get_string(proxy, name, signature, &value)) {
+        value = NULL;
+    }
+
+    l_free(*field);
+    *field = l_strdup(value);
 }
 
-struct l_dbus_proxy *iwd_proxies_get_station(const char *path)
+static void load_bool(struct l_dbus_proxy *proxy, const char *name, bool *field)
 {
-    return iwd_proxies_find("net.connman.iwd.Station", path);
+    bool value = false;
+    if (!s_ops->get_bool(proxy, name, &value)) {
+        value = false;
+    }
+
+    *field = value;
 }
 
-struct l_dbus_proxy *iwd_proxies_get_network(const char *path)
+// Decode a single property from the proxy into the cache
+static void proxy_entry_load(proxy_entry_t *entry, iwd_property_t property)
+{
+    struct l_dbus_proxy *proxy = entry->proxy;
+    iwd_proxy_props_t *props = &entry->props;
+
+    switch (property) {
+    case IWD_PROPERTY_NAME:
+        load_string(proxy, "Name", "s", &props->name);
+        break;
+
+    case IWD_PROPERTY_TYPE: {
+        const char *type = NULL;
+        if (!s_ops->get_string(proxy, "Type", "s", &type)) {
+            type = NULL;
+        }
+        props->security = iwd_security_from_string(type);
+        break;
+    }
+
+    case IWD_PROPERTY_HIDDEN:
+        load_bool(proxy, "Hidden", &props->hidden);
+        break;
+
+    case IWD_PROPERTY_CONNECTED:
+        load_bool(proxy, "Connected", &props->connected);
+        break;
+
+    case IWD_PROPERTY_DEVICE:
+        load_string(proxy, "Device", "o", &props->device_path);
+        break;
+
+    case IWD_PROPERTY_KNOWN_NETWORK:
+        load_string(proxy, "KnownNetwork", "o", &props->known_path);
+        break;
+
+    case IWD_PROPERTY_SCANNING:
+        load_bool(proxy, "Scanning", &props->scanning);
+        break;
+
+    case IWD_PROPERTY_STATE:
+        load_string(proxy, "State", "s", &props->state);
+        break;
+
+    case IWD_PROPERTY_CONNECTED_NETWORK:
+        load_string(proxy, "ConnectedNetwork", "o", &props->connected_path);
+        break;
+
+    default:
+        break;
+    }
+}
+
+static void proxy_entry_load_all(proxy_entry_t *entry)
 {
-    return iwd_proxies_find("net.connman.iwd.Network", path);
+    switch (entry->props.kind) {
+    case IWD_PROXY_DEVICE:
+        proxy_entry_load(entry, IWD_PROPERTY_NAME);
+        break;
+
+    case IWD_PROXY_STATION:
+        proxy_entry_load(entry, IWD_PROPERTY_SCANNING);
+        proxy_entry_load(entry, IWD_PROPERTY_STATE);
+        proxy_entry_load(entry, IWD_PROPERTY_CONNECTED_NETWORK);
+        break;
+
+    case IWD_PROXY_NETWORK:
+        proxy_entry_load(entry, IWD_PROPERTY_NAME);
+        proxy_entry_load(entry, IWD_PROPERTY_TYPE);
+        proxy_entry_load(entry, IWD_PROPERTY_CONNECTED);
+        proxy_entry_load(entry, IWD_PROPERTY_DEVICE);
+        proxy_entry_load(entry, IWD_PROPERTY_KNOWN_NETWORK);
+        break;
+
+    case IWD_PROXY_KNOWN_NETWORK:
+        proxy_entry_load(entry, IWD_PROPERTY_NAME);
+        proxy_entry_load(entry, IWD_PROPERTY_TYPE);
+        proxy_entry_load(entry, IWD_PROPERTY_HIDDEN);
+        break;
+
+    default:
+        break;
+    }
 }
 
-struct l_dbus_proxy *iwd_proxies_get_knownnetwork(const char *path)
+static void proxy_entry_destroy(void *data)
 {
-    return iwd_proxies_find("net.connman.iwd.KnownNetwork", path);
+    proxy_entry_t *entry = data;
+
+    l_free(entry->props.name);
+    l_free(entry->props.device_path);
+    l_free(entry->props.known_path);
+    l_free(entry->props.state);
+    l_free(entry->props.connected_path);
+    l_free(entry);
 }
 
-struct l_dbus_proxy *iwd_proxies_get_station_for_device(const char *device_name)
+//
+// Registry
+//
+
+void iwd_proxies_init(void)
 {
-    struct l_dbus_proxy *proxy_device = iwd_proxies_get_device_by_name(device_name);
-    if (!proxy_device) {
-        return NULL;
+    s_entry_by_proxy = l_hashmap_new();
+
+    for (iwd_proxy_kind_t kind = IWD_PROXY_DEVICE; kind < IWD_PROXY_KIND_COUNT; kind++) {
+        s_entry_by_path[kind] = l_hashmap_string_new();
+        s_entry_list[kind] = l_queue_new();
     }
 
-    const char *path_device = l_dbus_proxy_get_path(proxy_device);
-    struct l_dbus_proxy *proxy_station = iwd_proxies_get_station(path_device);
-    return proxy_station;
+    s_device_by_name = l_hashmap_string_new();
+    s_network_by_ssid = pair_key_hashmap_new();
+    s_knownnetwork_by_ssid = l_hashmap_string_new();
 }
 
-const char *iwd_proxies_get_device_name_for_station(struct l_dbus_proxy *proxy)
+void iwd_proxies_deinit(void)
 {
-    const char *path = l_dbus_proxy_get_path(proxy);
-    struct l_dbus_proxy *proxy_device = iwd_proxies_get_device_by_path(path);
-    if (!proxy_device) {
-        return NULL;
+    l_hashmap_destroy(s_device_by_name, NULL);
+    l_hashmap_destroy(s_network_by_ssid, NULL);
+    l_hashmap_destroy(s_knownnetwork_by_ssid, NULL);
+
+    for (iwd_proxy_kind_t kind = IWD_PROXY_DEVICE; kind < IWD_PROXY_KIND_COUNT; kind++) {
+        l_hashmap_destroy(s_entry_by_path[kind], NULL);
+        l_queue_destroy(s_entry_list[kind], NULL);
     }
 
-    const char *name;
-    if (!l_dbus_proxy_get_property(proxy_device, "Name", "s", &name)) {
-        return NULL;
+    l_hashmap_destroy(s_entry_by_proxy, proxy_entry_destroy);
+}
+
+void iwd_proxies_add(struct l_dbus_proxy *proxy)
+{
+    if (l_hashmap_lookup(s_entry_by_proxy, proxy)) {
+        l_warn("iwd_proxies: Proxy %s %s is already added",
+               s_ops->get_path(proxy), s_ops->get_interface(proxy));
+        return;
     }
 
-    return name;
+    proxy_entry_t *entry = l_new(proxy_entry_t, 1);
+    entry->proxy = proxy;
+    entry->props.kind = interface_to_kind(s_ops->get_interface(proxy));
+    entry->props.path = s_ops->get_path(proxy);
+    l_hashmap_insert(s_entry_by_proxy, proxy, entry);
+
+    if (entry->props.kind == IWD_PROXY_OTHER) {
+        return; // Nothing more is done with these
+    }
+
+    proxy_entry_load_all(entry);
+
+    l_hashmap_insert(s_entry_by_path[entry->props.kind], entry->props.path, entry);
+    l_queue_push_tail(s_entry_list[entry->props.kind], entry);
+    proxy_entry_index(entry);
+    s_generation[entry->props.kind]++;
 }
 
-struct l_dbus_proxy *iwd_proxies_get_network_for_ssid(const char *device_name, const char *ssid)
+void iwd_proxies_remove(struct l_dbus_proxy *proxy)
 {
-    struct l_dbus_proxy *device_proxy = iwd_proxies_get_device_by_name(device_name);
-    if (!device_proxy) {
-        return NULL;
+    proxy_entry_t *entry = l_hashmap_remove(s_entry_by_proxy, proxy);
+    if (entry == NULL) {
+        return;
     }
 
-    const char *device_path = l_dbus_proxy_get_path(device_proxy);
+    if (entry->props.kind != IWD_PROXY_OTHER) {
+        proxy_entry_unindex(entry);
+        l_hashmap_remove(s_entry_by_path[entry->props.kind], entry->props.path);
+        l_queue_remove(s_entry_list[entry->props.kind], entry);
+        s_generation[entry->props.kind]++;
+    }
 
-    for (const struct l_queue_entry *entry = l_queue_get_entries(s_iwd_proxies_list); entry; entry = entry->next) {
-        struct l_dbus_proxy *proxy = entry->data;
+    proxy_entry_destroy(entry);
+}
 
-        // Is it a Network?
-        if (!streq(l_dbus_proxy_get_interface(proxy), "net.connman.iwd.Network")) {
-            continue;
+void iwd_proxies_clear(void)
+{
+    l_hashmap_foreach_remove(s_device_by_name, hashmap_remove_all, NULL);
+    l_hashmap_foreach_remove(s_network_by_ssid, hashmap_remove_all, NULL);
+    l_hashmap_foreach_remove(s_knownnetwork_by_ssid, hashmap_remove_all, NULL);
+
+    for (iwd_proxy_kind_t kind = IWD_PROXY_DEVICE; kind < IWD_PROXY_KIND_COUNT; kind++) {
+        l_hashmap_foreach_remove(s_entry_by_path[kind], hashmap_remove_all, NULL);
+        if (!l_queue_isempty(s_entry_list[kind])) {
+            s_generation[kind]++;
         }
+        l_queue_clear(s_entry_list[kind], NULL);
+    }
 
-        // Does it have the correct SSID?
-        const char *name;
-        if (!l_dbus_proxy_get_property(proxy, "Name", "s", &name)) {
-            continue;
-        }
-        if (!streq(ssid, name)) {
-            continue;
-        }
+    l_hashmap_destroy(s_entry_by_proxy, proxy_entry_destroy);
+    s_entry_by_proxy = l_hashmap_new();
+}
 
-        // Is it on the correct device/interface?
-        const char *network_device_path;
-        if (!l_dbus_proxy_get_property(proxy, "Device", "o", &network_device_path)) {
-            continue;
-        }
-        if (!streq(network_device_path, device_path)) {
-            continue;
-        }
+iwd_proxy_kind_t iwd_proxies_get_kind(struct l_dbus_proxy *proxy)
+{
+    proxy_entry_t *entry = l_hashmap_lookup(s_entry_by_proxy, proxy);
+    return entry ? entry->props.kind : IWD_PROXY_OTHER;
+}
+
+const iwd_proxy_props_t *iwd_proxies_get_props(struct l_dbus_proxy *proxy)
+{
+    proxy_entry_t *entry = l_hashmap_lookup(s_entry_by_proxy, proxy);
+    return entry ? &entry->props : NULL;
+}
 
-        return proxy;
+void iwd_proxies_property_changed(struct l_dbus_proxy *proxy, iwd_property_t property)
+{
+    if (property == IWD_PROPERTY_UNKNOWN) {
+        return;
     }
 
-    return NULL;
+    proxy_entry_t *entry = l_hashmap_lookup(s_entry_by_proxy, proxy);
+    if (entry == NULL || entry->props.kind == IWD_PROXY_OTHER) {
+        return;
+    }
+
+    // Properties used as keys in the secondary indexes must be unindexed with the old value
+    bool is_key = property == IWD_PROPERTY_NAME || property == IWD_PROPERTY_DEVICE;
+    if (is_key) {
+        proxy_entry_unindex(entry);
+    }
+
+    proxy_entry_load(entry, property);
+
+    if (is_key) {
+        proxy_entry_index(entry);
+    }
+
+    s_generation[entry->props.kind]++;
 }
 
-struct l_dbus_proxy *iwd_proxies_get_knownnetwork_for_ssid(const char *ssid)
+uint32_t iwd_proxies_get_generation(iwd_proxy_kind_t kind)
 {
-    for (const struct l_queue_entry *entry = l_queue_get_entries(s_iwd_proxies_list); entry; entry = entry->next) {
-        struct l_dbus_proxy *proxy = entry->data;
+    return s_generation[kind];
+}
 
-        if (!streq(l_dbus_proxy_get_interface(proxy), "net.connman.iwd.KnownNetwork")) {
-            continue;
-        }
+static proxy_entry_t *iwd_proxies_find_entry(iwd_proxy_kind_t kind, const char *path)
+{
+    return l_hashmap_lookup(s_entry_by_path[kind], path);
+}
 
-        const char *name;
-        if (!l_dbus_proxy_get_property(proxy, "Name", "s", &name)) {
-            continue;
-        }
+static struct l_dbus_proxy *iwd_proxies_find(iwd_proxy_kind_t kind, const char *path)
+{
+    proxy_entry_t *entry = iwd_proxies_find_entry(kind, path);
+    return entry ? entry->proxy : NULL;
+}
 
-        if (streq(ssid, name)) {
-            return proxy;
-        }
+const iwd_proxy_props_t *iwd_proxies_get_props_by_path(iwd_proxy_kind_t kind, const char *path)
+{
+    proxy_entry_t *entry = iwd_proxies_find_entry(kind, path);
+    return entry ? &entry->props : NULL;
+}
+
+struct l_dbus_proxy *iwd_proxies_get_device_by_name(const char *device_name)
+{
+    proxy_entry_t *entry = l_hashmap_lookup(s_device_by_name, device_name);
+    return entry ? entry->proxy : NULL;
+}
+
+struct l_dbus_proxy *iwd_proxies_get_device_by_path(const char *path)
+{
+    return iwd_proxies_find(IWD_PROXY_DEVICE, path);
+}
+
+struct l_dbus_proxy *iwd_proxies_get_agent_manager(void)
+{
+    return iwd_proxies_find(IWD_PROXY_AGENT_MANAGER, "/net/connman/iwd");
+}
+
+struct l_dbus_proxy *iwd_proxies_get_station(const char *path)
+{
+    return iwd_proxies_find(IWD_PROXY_STATION, path);
+}
+
+struct l_dbus_proxy *iwd_proxies_get_network(const char *path)
+{
+    return iwd_proxies_find(IWD_PROXY_NETWORK, path);
+}
+
+struct l_dbus_proxy *iwd_proxies_get_knownnetwork(const char *path)
+{
+    return iwd_proxies_find(IWD_PROXY_KNOWN_NETWORK, path);
+}
+
+struct l_dbus_proxy *iwd_proxies_get_station_for_device(const char *device_name)
+{
+    proxy_entry_t *entry_device = l_hashmap_lookup(s_device_by_name, device_name);
+    if (!entry_device) {
+        return NULL;
+    }
+
+    struct l_dbus_proxy *proxy_station = iwd_proxies_get_station(entry_device->props.path);
+    return proxy_station;
+}
+
+struct l_dbus_proxy *iwd_proxies_get_station_diagnostic_for_device(const char *device_name)
+{
+    proxy_entry_t *entry_device = l_hashmap_lookup(s_device_by_name, device_name);
+    if (!entry_device) {
+        return NULL;
     }
 
-    return NULL;
+    return iwd_proxies_find(IWD_PROXY_STATION_DIAGNOSTIC, entry_device->props.path);
 }
 
-static void foreach_interface(const char *interface, iwd_proxies_foreach_func_t func, void *user_data)
+const char *iwd_proxies_get_device_name_for_station(struct l_dbus_proxy *proxy)
 {
-    for (const struct l_queue_entry *entry = l_queue_get_entries(s_iwd_proxies_list); entry; entry = entry->next) {
-        struct l_dbus_proxy *proxy = entry->data;
+    const char *path = s_ops->get_path(proxy);
+    proxy_entry_t *entry_device = iwd_proxies_find_entry(IWD_PROXY_DEVICE, path);
+    if (!entry_device) {
+        return NULL;
+    }
 
-        if (!streq(l_dbus_proxy_get_interface(proxy), interface)) {
-            continue;
-        }
+    return entry_device->props.name;
+}
 
-        func(proxy, user_data);
+struct l_dbus_proxy *iwd_proxies_get_network_for_ssid(const char *device_name, const char *ssid)
+{
+    proxy_entry_t *entry_device = l_hashmap_lookup(s_device_by_name, device_name);
+    if (!entry_device) {
+        return NULL;
+    }
+
+    pair_key_t key = { .first = entry_device->props.path, .second = ssid };
+    proxy_entry_t *entry = l_hashmap_lookup(s_network_by_ssid, &key);
+    return entry ? entry->proxy : NULL;
+}
+
+struct l_dbus_proxy *iwd_proxies_get_knownnetwork_for_ssid(const char *ssid)
+{
+    proxy_entry_t *entry = l_hashmap_lookup(s_knownnetwork_by_ssid, ssid);
+    return entry ? entry->proxy : NULL;
+}
+
+static void foreach_kind(iwd_proxy_kind_t kind, iwd_proxies_foreach_func_t func, void *user_data)
+{
+    for (const struct l_queue_entry *entry = l_queue_get_entries(s_entry_list[kind]); entry; entry = entry->next) {
+        proxy_entry_t *proxy_entry = entry->data;
+        func(proxy_entry->proxy, &proxy_entry->props, user_data);
     }
 }
 
 void iwd_proxies_foreach_known_network(iwd_proxies_foreach_func_t func, void *user_data)
 {
-    foreach_interface("net.connman.iwd.KnownNetwork", func, user_data);
+    foreach_kind(IWD_PROXY_KNOWN_NETWORK, func, user_data);
 }
 
 void iwd_proxies_foreach_station(iwd_proxies_foreach_func_t func, void *user_data)
 {
-    foreach_interface("net.connman.iwd.Station", func, user_data);
+    foreach_kind(IWD_PROXY_STATION, func, user_data);
 }
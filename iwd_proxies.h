@@ -4,8 +4,56 @@
 //****************************************************************************
 #pragma once
 
+#include "iwd_network.h"
+#include "iwd_property.h"
+
 #include <ell/ell.h>
 
+// Each proxy is tagged with its kind of interface when added
+typedef enum {
+    IWD_PROXY_OTHER = 0, // Interfaces we don't care about
+    IWD_PROXY_DEVICE,
+    IWD_PROXY_STATION,
+    IWD_PROXY_NETWORK,
+    IWD_PROXY_KNOWN_NETWORK,
+    IWD_PROXY_AGENT_MANAGER,
+    IWD_PROXY_STATION_DIAGNOSTIC, // No properties, only GetDiagnostics. Same path as the station.
+
+    IWD_PROXY_KIND_COUNT
+} iwd_proxy_kind_t;
+
+// Decoded properties of a proxy. Filled when the proxy is added and kept up to date on property changes.
+// Only the fields of the proxy kind are used. Strings are NULL if the property doesn't exist.
+typedef struct {
+    iwd_proxy_kind_t kind;
+    const char *path;
+
+    char *name; // Device, Network, KnownNetwork
+    iwd_security_t security; // Network, KnownNetwork. Type property
+    bool hidden; // KnownNetwork
+
+    bool connected; // Network
+    char *device_path; // Network
+    char *known_path; // Network. Only exists when it is a known network
+
+    bool scanning; // Station
+    char *state; // Station
+    char *connected_path; // Station. ConnectedNetwork, only exists when connected
+} iwd_proxy_props_t;
+
+// How the registry reads a proxy. By default it is ell's l_dbus_proxy.
+// Can be replaced with an in-memory implementation (passing its own objects as struct l_dbus_proxy *),
+// to measure lookups and list building without a bus. Must be set before any proxy is added.
+typedef struct {
+    const char *(*get_interface)(struct l_dbus_proxy *proxy);
+    const char *(*get_path)(struct l_dbus_proxy *proxy);
+    bool (*get_string)(struct l_dbus_proxy *proxy, const char *name, const char *signature, // "s" or "o"
+                       const char **value);
+    bool (*get_bool)(struct l_dbus_proxy *proxy, const char *name, bool *value);
+} iwd_proxies_ops_t;
+
+void iwd_proxies_set_ops(const iwd_proxies_ops_t *ops); // NULL restores ell
+
 void iwd_proxies_init(void);
 void iwd_proxies_deinit(void);
 
@@ -14,6 +62,17 @@ void iwd_proxies_remove(struct l_dbus_proxy *proxy);
 
 void iwd_proxies_clear(void);
 
+// Must be called on every property change, to keep the properties and the lookup indexes up to date
+void iwd_proxies_property_changed(struct l_dbus_proxy *proxy, iwd_property_t property);
+
+// Changes every time a proxy of the kind is added, removed or has a property changed. Starts at 0.
+uint32_t iwd_proxies_get_generation(iwd_proxy_kind_t kind);
+
+iwd_proxy_kind_t iwd_proxies_get_kind(struct l_dbus_proxy *proxy);
+
+const iwd_proxy_props_t *iwd_proxies_get_props(struct l_dbus_proxy *proxy);
+const iwd_proxy_props_t *iwd_proxies_get_props_by_path(iwd_proxy_kind_t kind, const char *path);
+
 struct l_dbus_proxy *iwd_proxies_get_device_by_name(const char *device_name);
 struct l_dbus_proxy *iwd_proxies_get_device_by_path(const char *path);
 
@@ -24,11 +83,13 @@ struct l_dbus_proxy *iwd_proxies_get_network(const char *path);
 struct l_dbus_proxy *iwd_proxies_get_knownnetwork(const char *path);
 
 struct l_dbus_proxy *iwd_proxies_get_station_for_device(const char *device_name);
+struct l_dbus_proxy *iwd_proxies_get_station_diagnostic_for_device(const char *device_name);
 const char *iwd_proxies_get_device_name_for_station(struct l_dbus_proxy *proxy);
 
 struct l_dbus_proxy *iwd_proxies_get_network_for_ssid(const char *device_name, const char *ssid);
 struct l_dbus_proxy *iwd_proxies_get_knownnetwork_for_ssid(const char *ssid);
 
-typedef void (*iwd_proxies_foreach_func_t)(struct l_dbus_proxy *proxy, void *user_data);
+typedef void (*iwd_proxies_foreach_func_t)(struct l_dbus_proxy *proxy, const iwd_proxy_props_t *props,
+                                           void *user_data);
 void iwd_proxies_foreach_known_network(iwd_proxies_foreach_func_t func, void *user_data);
 void iwd_proxies_foreach_station(iwd_proxies_foreach_func_t func, void *user_data);
@@ -0,0 +1,51 @@
+//****************************************************************************
+//    Copyright (C) 2022 Orbital Systems AB.
+//    All rights reserved
+//****************************************************************************
+#pragma once
+
+#include "iwd_network.h"
+
+#include <stdint.h>
+
+// Binary snapshot file of the station state, for a warm start. Memory-mappable: fixed size records and no pointers.
+// Native byte order, as it is only read back on the same machine.
+//
+//   iwd_snapshot_header_t
+//   iwd_snapshot_device_t[device_count]
+//   iwd_network_record_t[network_count] // Ordered networks of all devices, see first_network of the device
+//   iwd_snapshot_known_t[known_count]
+//   char strings[strings_size] // Paths. Offset 0 is an empty string.
+//
+// A new version is needed for any change of the layout.
+#define IWD_SNAPSHOT_MAGIC 0x53445749 // "IWDS"
+#define IWD_SNAPSHOT_VERSION 1
+#define IWD_SNAPSHOT_DEVICE_NAME_LEN 16 // IFNAMSIZ
+
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t header_size; // sizeof(iwd_snapshot_header_t)
+    uint32_t size; // Of the whole file
+    uint32_t device_count;
+    uint32_t network_count;
+    uint32_t known_count;
+    uint32_t strings_size;
+    uint32_t reserved;
+    int64_t saved_time; // time(), seconds since the epoch
+} iwd_snapshot_header_t;
+
+typedef struct {
+    char name[IWD_SNAPSHOT_DEVICE_NAME_LEN];
+    char connected_ssid[IWD_SSID_MAX_LEN + 1]; // Empty when disconnected
+    bool has_networks; // Ordered networks were fetched, even if there were none
+    uint32_t first_network;
+    uint32_t network_count;
+} iwd_snapshot_device_t;
+
+typedef struct {
+    char name[IWD_SSID_MAX_LEN + 1];
+    iwd_security_t security;
+    bool hidden;
+    uint32_t path_offset;
+} iwd_snapshot_known_t;
@@ -0,0 +1,48 @@
+//****************************************************************************
+//    Copyright (C) 2022 Orbital Systems AB.
+//    All rights reserved
+//****************************************************************************
+#include "iwd_stats.h"
+
+#include "iwd_client.h"
+#include "iwd_client_internal.h"
+
+#include <ell/ell.h>
+
+// Fixed size, nothing is allocated when recording
+static iwd_client_stats_t s_stats;
+
+void iwd_histogram_add(iwd_histogram_t *histogram, uint64_t usec)
+{
+    uint64_t msec = usec / 1000;
+
+    unsigned int bucket = 0;
+    while (msec > 0 && bucket < IWD_HISTOGRAM_BUCKETS - 1) {
+        msec >>= 1;
+        bucket++;
+    }
+
+    histogram->count++;
+    histogram->sum_usec += usec;
+    if (usec > histogram->max_usec) {
+        histogram->max_usec = usec;
+    }
+    histogram->buckets[bucket]++;
+}
+
+void iwd_stats_record(iwd_oper_t oper, iwd_status_t status, uint64_t start_usec)
+{
+    iwd_oper_stats_t *oper_stats = &s_stats.opers[oper];
+
+    if (status >= IWD_STATUS_COUNT) {
+        status = IWD_STATUS_OTHER_ERROR;
+    }
+    oper_stats->status[status]++;
+
+    iwd_histogram_add(&oper_stats->latency, l_time_now() - start_usec);
+}
+
+void iwd_client_stats_get(iwd_client_stats_t *stats)
+{
+    *stats = s_stats;
+}
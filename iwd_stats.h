@@ -0,0 +1,74 @@
+//****************************************************************************
+//    Copyright (C) 2022 Orbital Systems AB.
+//    All rights reserved
+//****************************************************************************
+#pragma once
+
+#include "iwd_status.h"
+
+#include <stdint.h>
+
+// Latency histogram with fixed buckets.
+// Bucket 0 is < 1 ms, bucket i is [2^(i-1), 2^i) ms and the last bucket is everything above.
+#define IWD_HISTOGRAM_BUCKETS 18 // Last bucket starts at 2^16 ms, ~65 s
+
+typedef struct {
+    uint32_t count;
+    uint64_t sum_usec;
+    uint64_t max_usec;
+    uint32_t buckets[IWD_HISTOGRAM_BUCKETS];
+} iwd_histogram_t;
+
+void iwd_histogram_add(iwd_histogram_t *histogram, uint64_t usec);
+
+//
+// Operations
+//
+
+typedef enum {
+    IWD_OPER_SCAN,
+    IWD_OPER_ORDERED_NETWORKS,
+    IWD_OPER_CONNECT,
+    IWD_OPER_FORGET,
+
+    IWD_OPER_COUNT
+} iwd_oper_t;
+
+#define IWD_STATUS_COUNT (IWD_STATUS_OTHER_ERROR + 1)
+
+typedef struct {
+    uint32_t status[IWD_STATUS_COUNT]; // Number of operations ended with each status. DBUS aborts are IWD_STATUS_DBUS_ABORTED
+    iwd_histogram_t latency; // From the call to the callback, all statuses
+} iwd_oper_stats_t;
+
+typedef struct {
+    iwd_oper_stats_t opers[IWD_OPER_COUNT];
+} iwd_client_stats_t;
+
+//
+// Connect timeline
+//
+
+typedef enum {
+    IWD_CONNECT_PHASE_PASSPHRASE, // Agent got RequestPassphrase and answered it
+    IWD_CONNECT_PHASE_CONNECTING, // Station State changed to "connecting"
+    IWD_CONNECT_PHASE_CONNECTED, // Station State changed to "connected"
+    IWD_CONNECT_PHASE_CONNECTED_NETWORK, // Station ConnectedNetwork changed to the network
+    IWD_CONNECT_PHASE_DONE, // Connect call returned (or failed)
+
+    IWD_CONNECT_PHASE_COUNT
+} iwd_connect_phase_t;
+
+#define IWD_CONNECT_TIMELINES 16 // Number of last connects kept
+
+typedef struct {
+    char device_name[16];
+    char ssid[33];
+    iwd_status_t status;
+    uint64_t start_usec; // l_time_now() when iwd_client_connect() was called
+    uint32_t phase_usec[IWD_CONNECT_PHASE_COUNT]; // Time from start to each phase. 0 if phase was not seen
+} iwd_connect_timeline_t;
+
+typedef struct {
+    iwd_histogram_t phases[IWD_CONNECT_PHASE_COUNT]; // Time from start, for the phases seen
+} iwd_connect_stats_t;
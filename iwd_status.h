@@ -26,7 +26,7 @@ typedef enum {
 
     IWD_STATUS_STATION_NOT_FOUND, // Wifi interface not found
     IWD_STATUS_NETWORK_NOT_FOUND, // Wifi SSID not found
-    IWD_STATUS_CONNECT_OVERRIDEN, // A later connect was run before this connect could complete
+    IWD_STATUS_CONNECT_OVERRIDEN, // A later connect on the same device was run before this connect could complete
 
     IWD_STATUS_DBUS_SEND_FAILED,
     IWD_STATUS_DBUS_ABORTED, // DBUS call was destroyed before we got a proper reply
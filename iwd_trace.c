@@ -0,0 +1,238 @@
+//****************************************************************************
+//    Copyright (C) 2022 Orbital Systems AB.
+//    All rights reserved
+//****************************************************************************
+#include "iwd_trace.h"
+
+#include "iwd_client.h"
+
+#include <ell/ell.h>
+
+#include <stdio.h>
+
+#define TRACE_ID_NONE 0 // NULL string
+#define TRACE_ID_OVERFLOW 1 // String table is full
+#define TRACE_ID_FIRST 2
+
+static iwd_trace_record_t s_records[IWD_TRACE_RECORDS];
+static unsigned int s_records_next;
+static unsigned int s_records_count;
+
+static struct l_hashmap *s_string_ids; // string -> id. NULL when not initialized
+static char *s_strings[IWD_TRACE_STRINGS]; // id -> string. NULL when free.
+static uint16_t s_string_refs[IWD_TRACE_STRINGS]; // id -> number of ids in records using it
+static unsigned int s_strings_count = TRACE_ID_FIRST; // Ids below have been used
+static uint16_t s_free_ids[IWD_TRACE_STRINGS]; // Ids below s_strings_count that are freed, to be used again
+static unsigned int s_free_count;
+
+static uint32_t s_call_seq; // Last call sequence number
+
+static const char * const event_table[IWD_TRACE_EVENT_COUNT] = {
+    [IWD_TRACE_CALL] = "CALL",
+    [IWD_TRACE_REPLY] = "REPLY",
+    [IWD_TRACE_ERROR] = "ERROR",
+    [IWD_TRACE_PROPERTY] = "PROPERTY",
+    [IWD_TRACE_PROXY_ADDED] = "ADDED",
+    [IWD_TRACE_PROXY_REMOVED] = "REMOVED",
+    [IWD_TRACE_AGENT] = "AGENT",
+    [IWD_TRACE_SIGNAL_LEVEL] = "LEVEL",
+};
+
+// Id of str, with one more reference
+static uint16_t trace_intern(const char *str)
+{
+    if (str == NULL) {
+        return TRACE_ID_NONE;
+    }
+
+    uint16_t id = L_PTR_TO_UINT(l_hashmap_lookup(s_string_ids, str));
+    if (id == TRACE_ID_NONE) {
+        if (s_free_count > 0) {
+            id = s_free_ids[--s_free_count];
+        }
+        else if (s_strings_count < IWD_TRACE_STRINGS) {
+            id = s_strings_count++;
+        }
+        else {
+            return TRACE_ID_OVERFLOW;
+        }
+
+        s_strings[id] = l_strdup(str);
+        l_hashmap_insert(s_string_ids, str, L_UINT_TO_PTR(id));
+    }
+
+    s_string_refs[id]++;
+    return id;
+}
+
+// One reference less to id. The string is freed when no record uses it.
+static void trace_release(uint16_t id)
+{
+    if (id < TRACE_ID_FIRST) {
+        return;
+    }
+
+    if (--s_string_refs[id] > 0) {
+        return;
+    }
+
+    l_hashmap_remove(s_string_ids, s_strings[id]);
+    l_free(s_strings[id]);
+    s_strings[id] = NULL;
+    s_free_ids[s_free_count++] = id;
+}
+
+static const char *trace_string(uint16_t id)
+{
+    if (id == TRACE_ID_NONE) {
+        return "";
+    }
+    if (id == TRACE_ID_OVERFLOW || id >= s_strings_count || s_strings[id] == NULL) {
+        return "?";
+    }
+    return s_strings[id];
+}
+
+void iwd_trace_record(iwd_trace_event_t event, const char *name, const char *path, const char *detail,
+                      int32_t value)
+{
+    if (s_string_ids == NULL) {
+        return; // Not initialized
+    }
+
+    // Interned before the strings of the overwritten record are released, so strings in both are kept
+    uint16_t name_id = trace_intern(name);
+    uint16_t path_id = trace_intern(path);
+    uint16_t detail_id = trace_intern(detail);
+
+    iwd_trace_record_t *record = &s_records[s_records_next];
+    if (s_records_count == IWD_TRACE_RECORDS) {
+        trace_release(record->name_id);
+        trace_release(record->path_id);
+        trace_release(record->detail_id);
+    }
+
+    record->time_usec = l_time_now();
+    record->event = event;
+    record->name_id = name_id;
+    record->path_id = path_id;
+    record->detail_id = detail_id;
+    record->value = value;
+
+    s_records_next = (s_records_next + 1) % IWD_TRACE_RECORDS;
+    if (s_records_count < IWD_TRACE_RECORDS) {
+        s_records_count++;
+    }
+}
+
+uint32_t iwd_trace_call(struct l_dbus_proxy *proxy, const char *method)
+{
+    if (++s_call_seq == 0) {
+        s_call_seq = 1; // 0 is never a call
+    }
+
+    iwd_trace_record(IWD_TRACE_CALL, method, l_dbus_proxy_get_path(proxy), NULL, (int32_t)s_call_seq);
+    return s_call_seq;
+}
+
+void iwd_trace_reply(struct l_dbus_proxy *proxy, const char *method, struct l_dbus_message *msg, uint32_t call_seq)
+{
+    const char *error_name = NULL;
+    if (l_dbus_message_is_error(msg)) {
+        const char *text = NULL;
+        (void)l_dbus_message_get_error(msg, &error_name, &text);
+    }
+
+    iwd_trace_record(error_name ? IWD_TRACE_ERROR : IWD_TRACE_REPLY, method, l_dbus_proxy_get_path(proxy),
+                     error_name, (int32_t)call_seq);
+}
+
+void iwd_trace_init(void)
+{
+    s_string_ids = l_hashmap_string_new();
+}
+
+void iwd_trace_deinit(void)
+{
+    l_hashmap_destroy(s_string_ids, NULL);
+    s_string_ids = NULL;
+
+    for (unsigned int id = TRACE_ID_FIRST; id < s_strings_count; id++) {
+        l_free(s_strings[id]);
+        s_strings[id] = NULL;
+        s_string_refs[id] = 0;
+    }
+    s_strings_count = TRACE_ID_FIRST;
+    s_free_count = 0;
+
+    // The ids of the records are gone with the strings
+    s_records_next = 0;
+    s_records_count = 0;
+}
+
+//
+// Dump
+//
+
+// Record i, oldest first
+static const iwd_trace_record_t *trace_record_at(unsigned int i)
+{
+    return &s_records[(s_records_next + IWD_TRACE_RECORDS - s_records_count + i) % IWD_TRACE_RECORDS];
+}
+
+// Call of the reply at i, by its sequence number, searched backwards. NULL if it is no longer in the ring.
+static const iwd_trace_record_t *trace_find_call(unsigned int i)
+{
+    const iwd_trace_record_t *reply = trace_record_at(i);
+    if (reply->value == 0) {
+        return NULL;
+    }
+
+    while (i-- > 0) {
+        const iwd_trace_record_t *record = trace_record_at(i);
+        if (record->event == IWD_TRACE_CALL && record->value == reply->value) {
+            return record;
+        }
+    }
+    return NULL;
+}
+
+void iwd_client_trace_dump(iwd_client_trace_line_cb_t line_cb, void *user_data)
+{
+    char line[512];
+
+    for (unsigned int i = 0; i < s_records_count; i++) {
+        const iwd_trace_record_t *record = trace_record_at(i);
+
+        int len = snprintf(line, sizeof(line), "%llu.%06llu %-8s %s %s",
+                           (unsigned long long)(record->time_usec / 1000000),
+                           (unsigned long long)(record->time_usec % 1000000),
+                           record->event < IWD_TRACE_EVENT_COUNT ? event_table[record->event] : "?",
+                           trace_string(record->name_id), trace_string(record->path_id));
+
+        if (record->detail_id != TRACE_ID_NONE && len > 0 && (size_t)len < sizeof(line)) {
+            len += snprintf(line + len, sizeof(line) - len, " %s", trace_string(record->detail_id));
+        }
+
+        if (record->event == IWD_TRACE_SIGNAL_LEVEL && len > 0 && (size_t)len < sizeof(line)) {
+            len += snprintf(line + len, sizeof(line) - len, " level=%d", record->value);
+        }
+
+        if ((record->event == IWD_TRACE_CALL || record->event == IWD_TRACE_REPLY ||
+             record->event == IWD_TRACE_ERROR) && len > 0 && (size_t)len < sizeof(line)) {
+            len += snprintf(line + len, sizeof(line) - len, " #%u", (uint32_t)record->value);
+        }
+
+        if ((record->event == IWD_TRACE_REPLY || record->event == IWD_TRACE_ERROR) &&
+            len > 0 && (size_t)len < sizeof(line)) {
+            const iwd_trace_record_t *call = trace_find_call(i);
+            if (call) {
+                uint64_t usec = record->time_usec - call->time_usec;
+                snprintf(line + len, sizeof(line) - len, " (+%llu.%03llu ms)",
+                         (unsigned long long)(usec / 1000), (unsigned long long)(usec % 1000));
+            }
+        }
+
+        line_cb(line, user_data);
+    }
+}
@@ -0,0 +1,58 @@
+//****************************************************************************
+//    Copyright (C) 2022 Orbital Systems AB.
+//    All rights reserved
+//****************************************************************************
+#pragma once
+
+#include <ell/ell.h>
+
+#include <stdint.h>
+
+// Flight recorder of all DBUS traffic and events, in a fixed size ring of binary records.
+// Strings (methods, interfaces, properties, paths, errors) are interned into ids when recorded, and the records
+// are only formatted when dumped. Recording is a timestamp, a few hash lookups and a copy. Always on.
+// Interned strings are counted by the records using them, and freed when the last of those is overwritten.
+
+#define IWD_TRACE_RECORDS 1024 // Last records kept
+#define IWD_TRACE_STRINGS 1024 // Interned strings in use at once. More than that are recorded as "?".
+
+typedef enum {
+    IWD_TRACE_CALL, // Method call sent. name = method, value = sequence number of the call
+    IWD_TRACE_REPLY, // name = method, value = sequence number of the call
+    IWD_TRACE_ERROR, // Error reply. name = method, detail = error name, value = sequence number of the call
+    IWD_TRACE_PROPERTY, // Property changed. name = property, detail = interface
+    IWD_TRACE_PROXY_ADDED, // name = interface
+    IWD_TRACE_PROXY_REMOVED, // name = interface
+    IWD_TRACE_AGENT, // Method called by iwd on our agents. name = method
+    IWD_TRACE_SIGNAL_LEVEL, // SignalLevelAgent Changed. value = level
+
+    IWD_TRACE_EVENT_COUNT
+} iwd_trace_event_t;
+
+typedef struct {
+    uint64_t time_usec; // l_time_now(), monotonic
+    uint16_t event; // iwd_trace_event_t
+    uint16_t name_id;
+    uint16_t path_id;
+    uint16_t detail_id;
+    int32_t value;
+} iwd_trace_record_t;
+
+void iwd_trace_init(void);
+void iwd_trace_deinit(void);
+
+void iwd_trace_record(iwd_trace_event_t event, const char *name, const char *path, const char *detail,
+                      int32_t value);
+// Method call about to be sent on proxy. Returns the sequence number of the call, never 0, to give to
+// iwd_trace_reply(). Kept with the user_data of the call.
+uint32_t iwd_trace_call(struct l_dbus_proxy *proxy, const char *method);
+// Reply to the method call with sequence number call_seq on proxy. Recorded as IWD_TRACE_ERROR if msg is an error.
+void iwd_trace_reply(struct l_dbus_proxy *proxy, const char *method, struct l_dbus_message *msg, uint32_t call_seq);
+
+// Text logging of every event on the hot paths (proxies, properties, ordered networks).
+// Compiled out with -DIWD_CLIENT_NO_HOT_LOG. The same events are in the trace.
+#ifdef IWD_CLIENT_NO_HOT_LOG
+#define IWD_HOT_DEBUG(...) do { } while (0)
+#else
+#define IWD_HOT_DEBUG(...) l_debug(__VA_ARGS__)
+#endif